@@ -0,0 +1,192 @@
+#include "contentstore.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+
+ContentStore::ContentStore()
+{
+    directory = ".qt-chat-store";
+}
+
+
+/**
+ * @brief Установка каталога хранилища
+ * @param dir - путь к каталогу (создается при первом добавлении файла)
+ */
+void ContentStore::setDirectory(const QString &dir)
+{
+    directory = dir;
+}
+
+
+/**
+ * @brief Вычисление хэша содержимого файла
+ * @param data - содержимое файла
+ * @return sha-256 в виде 64 шестнадцатеричных символов
+ */
+QByteArray ContentStore::digest(const QByteArray &data)
+{
+    return digest(data.constData(), data.size());
+}
+
+
+/**
+ * @brief Вычисление хэша части буфера (без копирования)
+ * @param data - начало содержимого файла
+ * @param size - размер содержимого (байты)
+ * @return sha-256 в виде 64 шестнадцатеричных символов
+ */
+QByteArray ContentStore::digest(const char *data, const int &size)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(data, size);
+    return hash.result().toHex();
+}
+
+
+/**
+ * @brief Проверка хэша, полученного от другого клиента
+ * @param file_digest - хэш
+ * @return true, если хэш - ровно 64 шестнадцатеричных символа в нижнем
+ * регистре (как формирует digest), иначе - false
+ *
+ * хэш становится именем файла в каталоге хранилища, поэтому любые другие
+ * символы (в том числе '/' и '.') отвергаются.
+ */
+bool ContentStore::isDigest(const QByteArray &file_digest)
+{
+    if (file_digest.size() != 64)
+    {
+        return false;
+    }
+    for (auto i = 0; i < file_digest.size(); i++)
+    {
+        char c = file_digest[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * @brief Добавление полученного файла в хранилище
+ * @param data - принятое содержимое файла
+ * @return true, если файл есть в хранилище, иначе - false
+ *
+ * хэш вычисляется по принятым данным, и в хранилище записываются они же (а
+ * не файл на диске, который мог быть изменен).
+ */
+bool ContentStore::add(const QByteArray &data)
+{
+    QString path = formPath(digest(data));
+    if (QFile::exists(path))
+    {
+        return true;
+    }
+    if (!QDir().mkpath(directory))
+    {
+        return false;
+    }
+
+    // копия сначала создается под временным именем, чтобы в хранилище не
+    // попал недописанный файл
+    QString part = path + ".part";
+    QFile stored(part);
+    if (!stored.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+            stored.write(data) != data.size())
+    {
+        stored.close();
+        QFile::remove(part);
+        return false;
+    }
+    stored.close();
+    QFile::setPermissions(part, QFileDevice::ReadOwner |
+                          QFileDevice::ReadUser | QFileDevice::ReadGroup |
+                          QFileDevice::ReadOther);
+    if (!QFile::rename(part, path))
+    {
+        QFile::remove(part);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Создание файла из хранилища
+ * @param file_digest - хэш содержимого файла
+ * @param file_name - создаваемый файл (существующий заменяется)
+ * @return true, если файл создан, false - если хэш некорректный (см.
+ * isDigest), содержимого нет в хранилище или создать файл не удалось
+ *
+ * создается отдельная копия (клон), доступная для записи, поэтому ее
+ * изменение не затрагивает хранилище.
+ */
+bool ContentStore::materialize(const QByteArray &file_digest,
+                               const QString &file_name)
+{
+    if (!isDigest(file_digest))
+    {
+        return false;
+    }
+    QString path = formPath(file_digest);
+    if (!QFile::exists(path))
+    {
+        return false;
+    }
+
+    QFile::remove(file_name);
+    if (!cloneOrCopy(path, file_name))
+    {
+        return false;
+    }
+    QFile::setPermissions(file_name, QFile::permissions(file_name) |
+                          QFileDevice::WriteOwner | QFileDevice::WriteUser);
+    return true;
+}
+
+
+QString ContentStore::formPath(const QByteArray &file_digest) const
+{
+    return directory + "/" + QString::fromLatin1(file_digest);
+}
+
+
+/**
+ * @brief Создание клона файла (общие блоки данных, копирование при
+ * изменении), при невозможности - копии
+ * @param from - исходный файл
+ * @param to - создаваемый файл (не должен существовать)
+ * @return true, если клон или копия создана, иначе - false
+ *
+ * клон создается только на Linux на файловых системах с его поддержкой
+ * (btrfs, xfs и т.п.), время не зависит от размера файла.
+ */
+bool ContentStore::cloneOrCopy(const QString &from, const QString &to)
+{
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    QFile source(from);
+    QFile target(to);
+    if (source.open(QIODevice::ReadOnly) &&
+            target.open(QIODevice::WriteOnly))
+    {
+        if (::ioctl(target.handle(), FICLONE, source.handle()) == 0)
+        {
+            return true;
+        }
+        target.close();
+        QFile::remove(to);
+    }
+#endif
+    return QFile::copy(from, to);
+}
@@ -0,0 +1,43 @@
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+
+#include <QByteArray>
+#include <QString>
+
+
+/**
+ * @brief Хранилище полученных файлов с адресацией по содержимому
+ *
+ * файл хранится в каталоге хранилища под именем, равным хэшу (sha-256, hex)
+ * его содержимого; в хранилище записываются принятые данные (отдельный файл
+ * только для чтения), поэтому изменение полученного файла не меняет
+ * содержимое хранилища и оно не перепроверяется при каждом использовании.
+ * Если отправитель предлагает файл, который уже есть в хранилище, он
+ * создается локально (клон или копия) без передачи данных.
+ */
+class ContentStore
+{
+public:
+    ContentStore();
+
+    void setDirectory(const QString &dir);
+
+    static QByteArray digest(const QByteArray &data);
+    static QByteArray digest(const char *data, const int &size);
+
+    static bool isDigest(const QByteArray &file_digest);
+
+    bool add(const QByteArray &data);
+
+    bool materialize(const QByteArray &file_digest, const QString &file_name);
+
+private:
+    // каталог хранилища
+    QString directory;
+
+    QString formPath(const QByteArray &file_digest) const;
+
+    static bool cloneOrCopy(const QString &from, const QString &to);
+};
+
+#endif // CONTENTSTORE_H
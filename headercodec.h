@@ -0,0 +1,165 @@
+#ifndef HEADERCODEC_H
+#define HEADERCODEC_H
+
+#include <QByteArray>
+#include <type_traits>
+
+#include "mytypes.h"
+
+
+/**
+ * @brief Виды пакетов (первый байт заголовка)
+ */
+struct MessageFlags
+{
+    // текстовое сообщение (или квитанция о доставке)
+    static constexpr char text = '0';
+
+    // файл
+    static constexpr char file = '1';
+
+    // несколько коротких сообщений в одном пакете
+    static constexpr char batch = '2';
+
+    // предложение файла по хэшу содержимого (общее количество пакетов - 2,
+    // номер - 0, см. UDPClient::sendFile)
+    static constexpr char offer = '3';
+
+    // ответ на предложение файла
+    static constexpr char offer_reply = '4';
+
+    static constexpr char first = text;
+    static constexpr char last = offer_reply;
+};
+
+
+/**
+ * @brief Кодирование заголовка пакета
+ *
+ * заголовок: флаг (1 байт), общее количество пакетов, порядковый номер
+ * пакета; числа записываются шестнадцатеричными символами, по 2 символа на
+ * байт Counter. Смещения и размеры известны на этапе компиляции, поэтому
+ * запись и чтение - циклы фиксированной длины без ветвлений, которые
+ * компилятор разворачивает.
+ *
+ * Counter = quint16 дает прежний формат (9 байт, 4 символа на число).
+ */
+template <typename Counter, typename Flags = MessageFlags>
+class HeaderCodec
+{
+    static_assert(std::is_unsigned<Counter>::value,
+                  "counter must be an unsigned integer");
+    static_assert(sizeof(Counter) <= sizeof(count_size),
+                  "count_size must hold any counter value");
+
+public:
+    typedef Counter counter_type;
+    typedef Flags flags;
+
+    // количество символов в записи одного числа
+    static constexpr int count_digits = 2 * int(sizeof(Counter));
+
+    static constexpr int flag_offset = 0;
+    static constexpr int total_offset = flag_offset + 1;
+    static constexpr int position_offset = total_offset + count_digits;
+
+    // размер заголовка (служебной информации в пакете)
+    static constexpr int size = position_offset + count_digits;
+
+    // максимальное количество пакетов в сообщении
+    static constexpr quint64 max_count = Counter(~Counter(0));
+
+    static_assert(size == 1 + 4 * int(sizeof(Counter)),
+                  "unexpected header layout");
+
+    /**
+     * @brief Запись числа шестнадцатеричными символами
+     * @param out - буфер (не меньше count_digits байт)
+     * @param value - число
+     */
+    static inline void storeCount(char *out, const Counter &value)
+    {
+        const char *hex = "0123456789abcdef";
+        for (int i = 0; i < count_digits; i++)
+        {
+            out[count_digits - 1 - i] = hex[(value >> (4 * i)) & 0xF];
+        }
+    }
+
+    /**
+     * @brief Чтение числа из шестнадцатеричных символов
+     * @param in - буфер (не меньше count_digits байт)
+     * @param ok - сюда записывается false, если встретился не hex символ
+     * @return число
+     */
+    static inline Counter loadCount(const char *in, bool &ok)
+    {
+        Counter value = 0;
+        bool valid = true;
+        for (int i = 0; i < count_digits; i++)
+        {
+            uchar c = uchar(in[i]);
+            valid = valid & ((uchar(c - '0') < 10) |
+                             (uchar((c | 0x20) - 'a') < 6));
+            // '0'-'9' -> 0-9, 'a'-'f' и 'A'-'F' -> 10-15
+            value = Counter((value << 4) | ((c & 0xF) + 9 * (c >> 6)));
+        }
+        ok = valid;
+        return value;
+    }
+
+    /**
+     * @brief Запись заголовка
+     * @param out - буфер (не меньше size байт)
+     * @param flag - вид пакета (см. Flags); передается по значению, так как
+     * ссылка на static constexpr член требует его определения вне класса
+     * @param total - общее количество пакетов
+     * @param position - порядковый номер пакета
+     */
+    static inline void encode(char *out, char flag,
+                              const Counter &total, const Counter &position)
+    {
+        out[flag_offset] = flag;
+        storeCount(out + total_offset, total);
+        storeCount(out + position_offset, position);
+    }
+
+    static inline QByteArray encode(char flag, const Counter &total,
+                                    const Counter &position)
+    {
+        QByteArray header(size, Qt::Uninitialized);
+        encode(header.data(), flag, total, position);
+        return header;
+    }
+
+    /**
+     * @brief Чтение заголовка
+     * @param in - пакет
+     * @param in_size - размер пакета
+     * @param flag - вид пакета
+     * @param total - общее количество пакетов
+     * @param position - порядковый номер пакета
+     * @return true, если заголовок корректный, иначе - false
+     */
+    static inline bool decode(const char *in, const int &in_size, char &flag,
+                              Counter &total, Counter &position)
+    {
+        if (in_size < size)
+        {
+            return false;
+        }
+        bool total_ok, position_ok;
+        flag = in[flag_offset];
+        total = loadCount(in + total_offset, total_ok);
+        position = loadCount(in + position_offset, position_ok);
+        return total_ok & position_ok &
+                (flag >= Flags::first) & (flag <= Flags::last);
+    }
+};
+
+
+// формат заголовка, используемый программой; ширина счетчика задается
+// QT_CHAT_COUNTER_BITS (см. mytypes.h)
+typedef HeaderCodec<wire_count> Header;
+
+#endif // HEADERCODEC_H
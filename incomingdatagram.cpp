@@ -6,24 +6,31 @@ IncomingDatagram::IncomingDatagram()
 
 }
 
-void IncomingDatagram::processDatagram(const QNetworkDatagram &n_datagram,
-                                       const count_size &byte_count_size,
-                                       const count_size &metadata_size)
+void IncomingDatagram::processDatagram(const QNetworkDatagram &n_datagram)
 {
-    bool ok;
     QByteArray datagram = n_datagram.data();
     sender.setAddress(n_datagram.senderAddress());
     sender.setPort(n_datagram.senderPort());
 
-    is_file = (datagram[0] == '1') ? true : false;
+    char flag = 0;
+    Header::counter_type total = 0, pos = 0;
+    is_valid = Header::decode(datagram.constData(), datagram.size(),
+                              flag, total, pos);
 
-    QByteArray count = datagram.mid(1, byte_count_size);
-    total_count = count.toUInt(&ok, 16);
+    is_file = (flag == Header::flags::file) ? true : false;
+    is_batch = (flag == Header::flags::batch) ? true : false;
+    is_offer = (flag == Header::flags::offer) ? true : false;
+    is_offer_reply = (flag == Header::flags::offer_reply) ? true : false;
 
-    QByteArray pos = datagram.mid(byte_count_size + 1, byte_count_size);
-    position = pos.toUInt(&ok, 16);
+    total_count = total;
+    position = pos;
 
-    byte_data = datagram.mid(metadata_size);
+    byte_data = datagram.mid(Header::size);
+}
+
+bool IncomingDatagram::isValid() const
+{
+    return is_valid;
 }
 
 bool IncomingDatagram::isFile() const
@@ -33,7 +40,22 @@ bool IncomingDatagram::isFile() const
 
 bool IncomingDatagram::isDelivered() const
 {
-    return (total_count == position);
+    return is_valid && (total_count == position);
+}
+
+bool IncomingDatagram::isBatch() const
+{
+    return is_batch;
+}
+
+bool IncomingDatagram::isOffer() const
+{
+    return is_offer;
+}
+
+bool IncomingDatagram::isOfferReply() const
+{
+    return is_offer_reply;
 }
 
 count_size IncomingDatagram::getPosition() const
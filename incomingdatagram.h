@@ -5,17 +5,20 @@
 #include <QNetworkDatagram>
 #include "client.h"
 #include "mytypes.h"
+#include "headercodec.h"
 
 class IncomingDatagram
 {
 public:
     IncomingDatagram();
-    void processDatagram(const QNetworkDatagram &n_datagram,
-                         const count_size &byte_count_size,
-                         const count_size &metadata_size);
+    void processDatagram(const QNetworkDatagram &n_datagram);
 
+    bool isValid(void) const;
     bool isFile(void) const;
     bool isDelivered(void) const;
+    bool isBatch(void) const;
+    bool isOffer(void) const;
+    bool isOfferReply(void) const;
 
     count_size getPosition(void) const;
     count_size getTotalCount(void) const;
@@ -28,7 +31,11 @@ private:
     count_size total_count;
     count_size position;
     Client sender;
+    bool is_valid;
     bool is_file;
+    bool is_batch;
+    bool is_offer;
+    bool is_offer_reply;
 };
 
 #endif // INCOMINGDATAGRAM_H
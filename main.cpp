@@ -1,12 +1,163 @@
 #include "mainwindow.h"
+#include "tracer.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+
+/**
+ * @brief Разбор адреса вида адрес:порт
+ * @param text - строка адреса
+ * @param client - результат
+ * @return true, если адрес корректный, иначе - false
+ */
+static bool parseClient(const QString &text, Client &client)
+{
+    int colon = text.lastIndexOf(':');
+    bool ok = false;
+    quint16 port = text.mid(colon + 1).toUShort(&ok);
+    QHostAddress address(text.left(colon));
+    if (colon < 0 || !ok || address.isNull())
+    {
+        return false;
+    }
+    client = Client(address, port);
+    return true;
+}
+
+
+/**
+ * @brief Применение настроек клиента из командной строки
+ * @param parser - разобранная командная строка
+ * @param client - клиент
+ * @return true, если все значения корректные, иначе - false
+ */
+static bool applyOptions(const QCommandLineParser &parser, UDPClient &client)
+{
+    QTextStream err(stderr);
+    bool ok = true;
+
+    if (parser.isSet("stripes"))
+    {
+        uint count = parser.value("stripes").toUInt(&ok);
+        if (!ok || count == 0)
+        {
+            err << "некорректное количество полос: "
+                << parser.value("stripes") << '\n';
+            return false;
+        }
+        client.setStripeCount(count);
+    }
+
+    if (parser.isSet("offload"))
+    {
+        uint segments = parser.value("offload").toUInt(&ok);
+        if (!ok || segments == 0)
+        {
+            err << "некорректное количество пакетов GSO: "
+                << parser.value("offload") << '\n';
+            return false;
+        }
+        client.setOffload(segments);
+    }
+
+    if (parser.isSet("linger"))
+    {
+        uint ms = parser.value("linger").toUInt(&ok);
+        if (!ok)
+        {
+            err << "некорректное время объединения сообщений: "
+                << parser.value("linger") << '\n';
+            return false;
+        }
+        client.setLinger(ms);
+    }
+
+    if (parser.isSet("store"))
+    {
+        client.setStoreDirectory(parser.value("store"));
+    }
+    client.setDedup(parser.isSet("dedup"));
+
+    QStringList routes = parser.values("route");
+    for (auto i = 0; i < routes.size(); i++)
+    {
+        QStringList ends = routes[i].split('=');
+        Client source, destination;
+        if (ends.size() != 2 || !parseClient(ends[0], source) ||
+                !parseClient(ends[1], destination))
+        {
+            err << "некорректный маршрут: " << routes[i] << '\n';
+            return false;
+        }
+        client.addRoute(source, destination);
+    }
+    return true;
+}
 
 
 int main(int argc, char *argv[])
 {
+    // трассировка пакетов включается переменной окружения QT_CHAT_TRACE,
+    // значение - файл, куда при выходе сохраняется трасса
+    QString trace_file = qEnvironmentVariable("QT_CHAT_TRACE");
+    Tracer::setEnabled(!trace_file.isEmpty());
+
     QApplication a(argc, argv);
-    MainWindow w;
-    w.show();
 
-    return a.exec();
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Чат на udp сокетах");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("route",
+        "Пересылать пакеты отправителя <источник> (адрес:порт, порт 0 - "
+        "любой) на <получатель> (адрес:порт), можно указать несколько раз.",
+        "источник=получатель"));
+    parser.addOption(QCommandLineOption("stripes",
+        "Количество полос (потоков) передачи файлов, у обоих клиентов "
+        "должно совпадать.", "количество"));
+    parser.addOption(QCommandLineOption("offload",
+        "Количество пакетов файла в одном вызове отправки (GSO, только "
+        "Linux).", "количество"));
+    parser.addOption(QCommandLineOption("linger",
+        "Время ожидания (мс) для объединения коротких сообщений в один пакет "
+        "(по умолчанию 0 - не объединять; получатель должен поддерживать "
+        "объединение, на пакет приходит одна квитанция).", "мс"));
+    parser.addOption(QCommandLineOption("dedup",
+        "Предлагать файл по хэшу перед передачей и хранить полученные файлы "
+        "(получатель должен поддерживать предложения)."));
+    parser.addOption(QCommandLineOption("store",
+        "Каталог хранилища полученных файлов (по умолчанию .qt-chat-store).",
+        "каталог"));
+    parser.process(a);
+
+    int result;
+    RelayStats relay;
+    {
+        MainWindow w;
+        if (!applyOptions(parser, w.getClient()))
+        {
+            return 1;
+        }
+        w.show();
+        result = a.exec();
+        relay = w.getClient().getRelayStats();
+    }
+
+    if (relay.forwarded > 0)
+    {
+        QTextStream(stdout) << "переслано пакетов: " << relay.forwarded
+                            << ", задержка на узле (мкс): средняя "
+                            << relay.latency_total_ns / relay.forwarded / 1000
+                            << ", наибольшая "
+                            << relay.latency_max_ns / 1000 << '\n';
+    }
+
+    // окно (и клиент вместе с потоками полос) уже уничтожено, поэтому
+    // события больше никто не пишет
+    if (!trace_file.isEmpty())
+    {
+        Tracer::setEnabled(false);
+        Tracer::dump(trace_file);
+    }
+    return result;
 }
@@ -39,6 +39,15 @@ MainWindow::~MainWindow()
 }
 
 
+/**
+ * @brief Клиент чата (для настроек, задаваемых при запуске)
+ */
+UDPClient &MainWindow::getClient()
+{
+    return client;
+}
+
+
 void MainWindow::on_new_message(const Client &sender,
                                 const QString &message)
 {
@@ -115,7 +124,12 @@ void MainWindow::on_send_btn_clicked()
     if (connected_local && connected_remote)
     {
         QString message = ui->message->text();
-        client.sendMessage(message);
+        if (!client.sendMessage(message))
+        {
+            QMessageBox::warning(this, "Ошибка",
+                                 "Сообщение слишком длинное для отправки");
+            return;
+        }
         ui->message->clear();
         ui->message_list->addItem("Вы: " + message);
     }
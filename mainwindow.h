@@ -24,6 +24,8 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
+    UDPClient &getClient(void);
+
 public slots:
     void on_new_message(const Client &sender, const QString &message);
     void on_message_delivered(const Client &sender);
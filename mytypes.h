@@ -1,6 +1,25 @@
 #ifndef MYTYPES_H
 #define MYTYPES_H
 
+#include <QtGlobal>
+
+// ширина счетчиков пакетов в заголовке (16, 32 или 64 бит), задается в
+// qt-chat.pro; 16 - прежний формат заголовка
+#ifndef QT_CHAT_COUNTER_BITS
+#define QT_CHAT_COUNTER_BITS 16
+#endif
+
+#if QT_CHAT_COUNTER_BITS == 16
+typedef quint16 wire_count;
+typedef quint32 count_size;
+#elif QT_CHAT_COUNTER_BITS == 32
+typedef quint32 wire_count;
 typedef quint32 count_size;
+#elif QT_CHAT_COUNTER_BITS == 64
+typedef quint64 wire_count;
+typedef quint64 count_size;
+#else
+#error "QT_CHAT_COUNTER_BITS must be 16, 32 or 64"
+#endif
 
 #endif // MYTYPES_H
@@ -0,0 +1,82 @@
+#include "outgoingmessage.h"
+
+#include <string.h>
+
+
+/**
+ * @brief Количество пакетов, на которое разделяется сообщение
+ * @param data_size - размер сообщения (байты)
+ * @param datagram_size - размер данных в пакете
+ * @return количество пакетов
+ */
+quint64 OutgoingMessage::countDatagrams(const qint64 &data_size,
+                                        const uint &datagram_size)
+{
+    return (quint64(data_size) + datagram_size - 1) / datagram_size;
+}
+
+
+/**
+ * @brief Формирование пакетов сообщения
+ * @param data - сообщение целиком
+ * @param flag - вид пакетов (см. MessageFlags)
+ * @param datagram_size - размер данных в пакете
+ * @param first - порядковый номер первого формируемого пакета
+ * @param count - количество формируемых пакетов
+ * @return пакеты first .. first + count - 1 по порядку
+ *
+ * в заголовок каждого пакета записывается общее количество пакетов всего
+ * сообщения, поэтому пакеты, сформированные по частям, собираются
+ * получателем так же, как сформированные за один раз. Количество пакетов
+ * сообщения должно помещаться в счетчик заголовка (проверяет вызывающий код).
+ */
+QVector<QByteArray> OutgoingMessage::formDatagrams(const QByteArray &data,
+                                                   char flag,
+                                                   const uint &datagram_size,
+                                                   const count_size &first,
+                                                   const count_size &count)
+{
+    QVector<QByteArray> datagrams;
+    count_size data_size = data.size();
+    count_size total = countDatagrams(data_size, datagram_size);
+    count_size last = qMin(total, first + count);
+    if (first >= last)
+    {
+        return datagrams;
+    }
+
+    datagrams.reserve(last - first);
+    for (count_size position = first; position < last; position++)
+    {
+        count_size pos = position * datagram_size;
+        int chunk_size = qMin(count_size(datagram_size), data_size - pos);
+        QByteArray datagram(Header::size + chunk_size, Qt::Uninitialized);
+        Header::encode(datagram.data(), flag, total, position);
+        memcpy(datagram.data() + Header::size, data.constData() + pos,
+               chunk_size);
+        datagrams.append(datagram);
+    }
+    return datagrams;
+}
+
+
+/**
+ * @brief Ключ события трассировки пакета
+ * @param datagram - пакет с заголовком
+ * @return общее количество пакетов и порядковый номер пакета, нули - если
+ * трассировка выключена или заголовок некорректный
+ */
+DatagramTraceKey OutgoingMessage::traceKey(const QByteArray &datagram)
+{
+    DatagramTraceKey key = {0, 0};
+    char flag;
+    Header::counter_type total, position;
+    if (Tracer::isEnabled() &&
+            Header::decode(datagram.constData(), datagram.size(), flag,
+                           total, position))
+    {
+        key.total = total;
+        key.position = position;
+    }
+    return key;
+}
@@ -0,0 +1,60 @@
+#ifndef OUTGOINGMESSAGE_H
+#define OUTGOINGMESSAGE_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include "mytypes.h"
+#include "headercodec.h"
+#include "tracer.h"
+
+
+/**
+ * @brief Ключ события трассировки пакета
+ *
+ * общее количество пакетов сообщения и порядковый номер пакета из
+ * заголовка - так же записываются события приема, поэтому события одного
+ * пакета у отправителя и получателя сопоставляются.
+ */
+struct DatagramTraceKey
+{
+    quint64 total;
+    quint64 position;
+};
+
+
+/**
+ * @brief Разделение исходящего сообщения на пакеты
+ *
+ * не зависит от сокета и состояния клиента, поэтому вызывается как из
+ * основного потока, так и из потоков полос (каждая полоса формирует только
+ * свои пакеты).
+ */
+class OutgoingMessage
+{
+public:
+    static quint64 countDatagrams(const qint64 &data_size,
+                                  const uint &datagram_size);
+
+    static QVector<QByteArray> formDatagrams(const QByteArray &data,
+                                             char flag,
+                                             const uint &datagram_size,
+                                             const count_size &first,
+                                             const count_size &count);
+
+    static DatagramTraceKey traceKey(const QByteArray &datagram);
+};
+
+
+// интервал трассировки с ключом из заголовка пакета (заголовок разбирается,
+// только если трассировка включена)
+#define TRACE_DATAGRAM_SCOPE(name, datagram) \
+    const DatagramTraceKey trace_key = OutgoingMessage::traceKey(datagram); \
+    TRACE_SCOPE(name, trace_key.total, trace_key.position)
+
+#define TRACE_DATAGRAM_INSTANT(name, datagram) \
+    do { if (Tracer::isEnabled()) { \
+        DatagramTraceKey key = OutgoingMessage::traceKey(datagram); \
+        Tracer::instant(name, key.total, key.position); } } while (0)
+
+#endif // OUTGOINGMESSAGE_H
@@ -23,20 +23,39 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Width of the packet counters in the datagram header (16, 32 or 64 bits).
+# 16 keeps the original 9-byte header; all peers must use the same value.
+#DEFINES += QT_CHAT_COUNTER_BITS=32
+
 
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
     udpclient.cpp \
     client.cpp \
-    incomingdatagram.cpp
+    incomingdatagram.cpp \
+    stripesender.cpp \
+    tracer.cpp \
+    udpoffload.cpp \
+    reassemblymanager.cpp \
+    contentstore.cpp \
+    utf8decoder.cpp \
+    outgoingmessage.cpp
 
 HEADERS += \
         mainwindow.h \
     udpclient.h \
     client.h \
     incomingdatagram.h \
-    mytypes.h
+    mytypes.h \
+    stripesender.h \
+    tracer.h \
+    udpoffload.h \
+    reassemblymanager.h \
+    contentstore.h \
+    utf8decoder.h \
+    headercodec.h \
+    outgoingmessage.h
 
 FORMS += \
         mainwindow.ui
@@ -0,0 +1,262 @@
+#include "reassemblymanager.h"
+#include "tracer.h"
+
+#include <QStringList>
+#include <QMutexLocker>
+
+
+namespace
+{
+
+// память на хранение одного пакета сверх его данных (узел QHash, заголовок
+// QByteArray) - учитывается, чтобы мелкие пакеты не обходили ограничения
+const qint64 part_overhead = 96;
+
+}
+
+
+ReassemblyManager::ReassemblyManager()
+{
+    total_bytes = 0;
+    memory_budget = Q_INT64_C(1024) * 1024 * 1024;
+    peer_quota = Q_INT64_C(512) * 1024 * 1024;
+    timeout = 60000;
+    stats = ReassemblyStats();
+    clock.start();
+}
+
+
+/**
+ * @brief Установка ограничений памяти и времени ожидания
+ * @param budget - общий бюджет памяти (байты)
+ * @param quota - квота памяти на одного отправителя (байты)
+ * @param timeout_ms - время ожидания следующего пакета сообщения (мс)
+ *
+ * сообщение, которое не помещается в квоту (оценивается по размеру пакета и
+ * общему количеству пакетов), отбрасывается сразу.
+ */
+void ReassemblyManager::setLimits(const qint64 &budget, const qint64 &quota,
+                                  const qint64 &timeout_ms)
+{
+    QMutexLocker locker(&mutex);
+    if (budget > 0 && quota > 0 && timeout_ms > 0)
+    {
+        memory_budget = budget;
+        peer_quota = qMin(quota, budget);
+        timeout = timeout_ms;
+    }
+}
+
+
+/**
+ * @brief Добавление пакета сообщения
+ * @param datagram - входящий пакет (не квитанция и не пакет с несколькими
+ * сообщениями)
+ * @param message - сюда записывается собранное сообщение
+ * @param created - если задан, сюда записывается, начата ли пакетом новая
+ * частичная сборка (по нему запускается проверка устаревших сообщений)
+ * @return true, если сообщение собрано полностью, иначе - false
+ *
+ * если у отправителя уже есть частично собранное сообщение того же вида с
+ * другим общим количеством пакетов, оно считается устаревшим и удаляется.
+ */
+bool ReassemblyManager::insert(const IncomingDatagram &datagram,
+                               QByteArray &message, bool *created)
+{
+    if (created)
+    {
+        *created = false;
+    }
+    count_size total_count = datagram.getTotalCount();
+    count_size position = datagram.getPosition();
+    QByteArray data = datagram.getData();
+    qint64 size = data.size();
+    QMutexLocker locker(&mutex);
+
+    // пакеты, кроме последнего, одного размера - по ним оценивается размер
+    // всего сообщения (деление вместо умножения - без переполнения)
+    bool too_big = (position + 1 < total_count) &&
+            quint64(total_count) > quint64(peer_quota / (size + part_overhead));
+    if (total_count == 0 || position >= total_count || too_big)
+    {
+        stats.rejected++;
+        return false;
+    }
+
+    QString peer = datagram.getSender().formPrettyAddress();
+    QString key = peer + (datagram.isFile() ? "/file" : "/text");
+
+    auto it = partials.find(key);
+    if (it != partials.end() && it->total_count != total_count)
+    {
+        remove(key);
+        stats.evicted_replaced++;
+    }
+
+    if (total_count == 1)
+    {
+        message = data;
+        return true;
+    }
+
+    if (!partials.contains(key))
+    {
+        PartialMessage partial;
+        partial.total_count = total_count;
+        partial.bytes = 0;
+        partial.peer = peer;
+        partials.insert(key, partial);
+        if (created)
+        {
+            *created = true;
+        }
+    }
+
+    PartialMessage &partial = partials[key];
+    qint64 delta = size + part_overhead;
+    auto part = partial.parts.constFind(position);
+    if (part != partial.parts.constEnd())
+    {
+        // повторный пакет заменяет прежний
+        delta -= part->size() + part_overhead;
+    }
+    partial.parts.insert(position, data);
+    partial.bytes += delta;
+    partial.last_activity = clock.elapsed();
+    peer_bytes[peer] += delta;
+    total_bytes += delta;
+
+    while (peer_bytes.value(peer) > peer_quota && evictLru(peer, key))
+    {
+    }
+    while (total_bytes > memory_budget && evictLru(QString(), key))
+    {
+    }
+    if (peer_bytes.value(peer) > peer_quota || total_bytes > memory_budget)
+    {
+        remove(key);
+        stats.rejected++;
+        return false;
+    }
+
+    PartialMessage &current = partials[key];
+    if (count_size(current.parts.size()) != total_count)
+    {
+        return false;
+    }
+
+    qint64 start = Tracer::isEnabled() ? Tracer::now() : -1;
+    message.clear();
+    message.reserve(current.bytes - qint64(total_count) * part_overhead);
+    for (count_size i = 0; i < total_count; i++)
+    {
+        message.append(current.parts[i]);
+    }
+    remove(key);
+    if (start >= 0)
+    {
+        Tracer::complete("reassembly", start, message.size(), 0);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Удаление сообщений, не получавших пакетов дольше timeout
+ */
+void ReassemblyManager::evictExpired()
+{
+    QMutexLocker locker(&mutex);
+    qint64 now = clock.elapsed();
+    QStringList expired;
+    for (auto it = partials.constBegin(); it != partials.constEnd(); it++)
+    {
+        if (now - it->last_activity > timeout)
+        {
+            expired.append(it.key());
+        }
+    }
+
+    for (auto i = 0; i < expired.size(); i++)
+    {
+        remove(expired[i]);
+        stats.evicted_timeout++;
+    }
+}
+
+
+/**
+ * @brief Проверка, есть ли частично собранные сообщения
+ * @return true, если частично собранных сообщений нет, иначе - false
+ */
+bool ReassemblyManager::isEmpty() const
+{
+    QMutexLocker locker(&mutex);
+    return partials.isEmpty();
+}
+
+
+/**
+ * @brief Получение статистики сборки
+ * @return счетчики удалений и отброшенных пакетов, текущий объем памяти
+ */
+ReassemblyStats ReassemblyManager::getStats() const
+{
+    QMutexLocker locker(&mutex);
+    ReassemblyStats result = stats;
+    result.buffered_bytes = total_bytes;
+    return result;
+}
+
+
+void ReassemblyManager::remove(const QString &key)
+{
+    auto it = partials.find(key);
+    if (it == partials.end())
+    {
+        return;
+    }
+
+    qint64 &bytes = peer_bytes[it->peer];
+    bytes -= it->bytes;
+    if (bytes <= 0)
+    {
+        peer_bytes.remove(it->peer);
+    }
+    total_bytes -= it->bytes;
+    partials.erase(it);
+}
+
+
+/**
+ * @brief Удаление давно не обновлявшегося сообщения (LRU)
+ * @param peer - отправитель, среди сообщений которого ищется кандидат,
+ * пустая строка - среди всех
+ * @param keep - ключ сообщения, которое удалять нельзя
+ * @return true, если сообщение было удалено, иначе - false
+ */
+bool ReassemblyManager::evictLru(const QString &peer, const QString &keep)
+{
+    QString victim;
+    qint64 oldest = 0;
+    for (auto it = partials.constBegin(); it != partials.constEnd(); it++)
+    {
+        if (it.key() == keep || (!peer.isEmpty() && it->peer != peer))
+        {
+            continue;
+        }
+        if (victim.isEmpty() || it->last_activity < oldest)
+        {
+            victim = it.key();
+            oldest = it->last_activity;
+        }
+    }
+
+    if (victim.isEmpty())
+    {
+        return false;
+    }
+    remove(victim);
+    stats.evicted_memory++;
+    return true;
+}
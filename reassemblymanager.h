@@ -0,0 +1,111 @@
+#ifndef REASSEMBLYMANAGER_H
+#define REASSEMBLYMANAGER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QElapsedTimer>
+#include <QMutex>
+
+#include "mytypes.h"
+#include "incomingdatagram.h"
+
+
+/**
+ * @brief Статистика сборки входящих сообщений
+ */
+struct ReassemblyStats
+{
+    // частично собранные сообщения, удаленные по истечению времени ожидания
+    quint64 evicted_timeout;
+
+    // частично собранные сообщения, удаленные из-за ограничения памяти
+    quint64 evicted_memory;
+
+    // частично собранные сообщения, замененные новым сообщением того же
+    // отправителя (изменилось общее количество пакетов)
+    quint64 evicted_replaced;
+
+    // отброшенные пакеты (некорректный заголовок или сообщение не помещается
+    // в ограничения памяти)
+    quint64 rejected;
+
+    // байт в частично собранных сообщениях сейчас (вместе с накладными
+    // расходами на хранение каждого пакета)
+    qint64 buffered_bytes;
+};
+
+
+/**
+ * @brief Сборка входящих сообщений из пакетов с ограничением памяти
+ *
+ * частично собранные сообщения хранятся отдельно для каждого отправителя
+ * (адреса и порта; порт пакетов полос приводится к порту основного сокета
+ * отправителя, см. StripeSender) и вида сообщения (текст/файл). Память,
+ * включая накладные расходы на каждый пакет, ограничена общим бюджетом и
+ * квотой на отправителя; при превышении удаляются давно не обновлявшиеся
+ * сообщения (LRU), сообщения без новых пакетов дольше timeout удаляются при
+ * периодической проверке (evictExpired).
+ *
+ * используется одновременно основным потоком и потоками полос, поэтому
+ * открытые методы выполняются под общим мьютексом.
+ */
+class ReassemblyManager
+{
+public:
+    ReassemblyManager();
+
+    void setLimits(const qint64 &budget, const qint64 &quota,
+                   const qint64 &timeout_ms);
+
+    bool insert(const IncomingDatagram &datagram, QByteArray &message,
+                bool *created = nullptr);
+
+    void evictExpired(void);
+
+    bool isEmpty(void) const;
+
+    ReassemblyStats getStats(void) const;
+
+private:
+    struct PartialMessage
+    {
+        QHash<count_size, QByteArray> parts;
+        count_size total_count;
+        qint64 bytes;
+        qint64 last_activity;
+        QString peer;
+    };
+
+    // частично собранные сообщения, ключ - отправитель и вид сообщения
+    QHash<QString, PartialMessage> partials;
+
+    // байт в частично собранных сообщениях каждого отправителя
+    QHash<QString, qint64> peer_bytes;
+
+    // байт во всех частично собранных сообщениях
+    qint64 total_bytes;
+
+    // общий бюджет памяти (байты)
+    qint64 memory_budget;
+
+    // квота памяти на одного отправителя (байты)
+    qint64 peer_quota;
+
+    // время ожидания следующего пакета сообщения (мс)
+    qint64 timeout;
+
+    // часы для отметок последней активности
+    QElapsedTimer clock;
+
+    ReassemblyStats stats;
+
+    // защищает все поля при обращении из нескольких потоков
+    mutable QMutex mutex;
+
+    void remove(const QString &key);
+
+    bool evictLru(const QString &peer, const QString &keep);
+};
+
+#endif // REASSEMBLYMANAGER_H
@@ -0,0 +1,238 @@
+#include "stripesender.h"
+#include "incomingdatagram.h"
+#include "outgoingmessage.h"
+
+
+StripeSender::StripeSender(const quint16 &offset,
+                           ReassemblyManager *shared_reassembly,
+                           QObject *parent) : QObject(parent)
+{
+    port_offset = offset;
+    reassembly = shared_reassembly;
+    forward_all = false;
+    next_datagram = 0;
+    gso_segments = 1;
+
+    // сокет и таймер - дочерние объекты, поэтому переносятся в поток
+    // вместе с отправителем полосы (moveToThread)
+    _socket = new QUdpSocket(this);
+    connect(_socket, &QUdpSocket::readyRead,
+            this, &StripeSender::onReadyRead);
+
+    tmr = new QTimer(this);
+    connect(tmr, &QTimer::timeout, this, &StripeSender::sendDatagram);
+}
+
+
+/**
+ * @brief Привязка сокета полосы
+ * @param address - адрес основного сокета
+ * @param port - порт основного сокета
+ * @return true, если связывание прошло успешно, иначе - false
+ *
+ * сокет полосы привязывается к порту port + port_offset;
+ * вызывается в потоке полосы.
+ */
+bool StripeSender::bindStripe(const QHostAddress &address,
+                              const quint16 &port)
+{
+    if (uint(port) + port_offset > 65535)
+    {
+        return false;
+    }
+    _socket->close();
+    return _socket->bind(address, port + port_offset);
+}
+
+
+/**
+ * @brief Постановка полосы в очередь на отправку
+ * @param data - файл целиком (вместе с названием)
+ * @param flag - вид пакетов (см. MessageFlags)
+ * @param datagram_size - размер данных в пакете
+ * @param first - порядковый номер первого пакета полосы
+ * @param count - количество пакетов полосы
+ * @param stripe_receiver - получатель (адрес его основного сокета)
+ * @param ms - интервал отправки пакетов (в миллисекундах)
+ * @param segments - количество пакетов, отправляемых за интервал одним
+ * вызовом (GSO), 1 - по одному
+ *
+ * вызывается в потоке отправителя полосы (через очередь событий), пакеты
+ * полосы формируются здесь же. Когда все пакеты полосы отправлены (или
+ * полосу отправить нельзя), посылается сигнал stripeSent.
+ */
+void StripeSender::sendStripe(const QByteArray &data,
+                              char flag,
+                              const uint &datagram_size,
+                              const count_size &first,
+                              const count_size &count,
+                              const Client &stripe_receiver,
+                              const uint &ms,
+                              const uint &segments)
+{
+    if (_socket->state() != QAbstractSocket::BoundState ||
+            uint(stripe_receiver.getPort()) + port_offset > 65535)
+    {
+        emit stripeSent();
+        return;
+    }
+
+    receiver = stripe_receiver;
+    receiver.setPort(stripe_receiver.getPort() + port_offset);
+    gso_segments = segments;
+    {
+        TRACE_SCOPE("formStripe", data.size(), first);
+        stripe_to_send.append(OutgoingMessage::formDatagrams(
+                                  data, flag, datagram_size, first, count));
+    }
+    tmr->setInterval(ms);
+    if (!tmr->isActive())
+    {
+        tmr->start();
+    }
+}
+
+
+/**
+ * @brief Включение/выключение передачи всех пакетов в UDPClient без сборки
+ * @param on - true - передавать все пакеты (включена пересылка),
+ * false - собирать сообщения в потоке полосы
+ */
+void StripeSender::setForwardAll(const bool &on)
+{
+    forward_all = on;
+}
+
+
+/**
+ * @brief Прием пакетов на сокет полосы
+ *
+ * пакеты сообщений из нескольких пакетов добавляются в общую сборку, когда
+ * сообщение собрано полностью, оно передается через messageReceived;
+ * квитанции, служебные пакеты и сообщения из одного пакета передаются через
+ * datagramReceived вместе со временем приема (для статистики пересылки).
+ * Некорректные пакеты отбрасываются.
+ */
+void StripeSender::onReadyRead()
+{
+    IncomingDatagram datagram;
+    QNetworkDatagram n_datagram;
+
+    while (_socket->hasPendingDatagrams())
+    {
+        qint64 received_ns =
+                QDeadlineTimer::current(Qt::PreciseTimer).deadlineNSecs();
+        n_datagram = _socket->receiveDatagram(_socket->pendingDatagramSize());
+        if (n_datagram.senderPort() <= port_offset)
+        {
+            continue;
+        }
+        n_datagram.setSender(n_datagram.senderAddress(),
+                             n_datagram.senderPort() - port_offset);
+
+        if (forward_all)
+        {
+            emit datagramReceived(n_datagram, received_ns);
+            continue;
+        }
+
+        datagram.processDatagram(n_datagram);
+        if (!datagram.isValid())
+        {
+            continue;
+        }
+        if (datagram.isDelivered() || datagram.isBatch() ||
+                datagram.isOffer() || datagram.isOfferReply() ||
+                datagram.getTotalCount() == 1)
+        {
+            emit datagramReceived(n_datagram, received_ns);
+            continue;
+        }
+
+        TRACE_INSTANT("stripeReceiveDatagram", datagram.getTotalCount(),
+                      datagram.getPosition());
+        QByteArray message;
+        bool created = false;
+        if (reassembly->insert(datagram, message, &created))
+        {
+            emit messageReceived(n_datagram, message);
+        }
+        else if (created)
+        {
+            // проверку устаревших сообщений запускает основной поток
+            emit partialCreated();
+        }
+    }
+}
+
+
+/**
+ * @brief Отправляет очередной пакет полосы по истечению интервала
+ *
+ * пакеты отправляются по порядку; когда полоса отправлена, таймер
+ * останавливается. При включенном GSO за интервал отправляется до
+ * gso_segments пакетов одного размера одним вызовом.
+ */
+void StripeSender::sendDatagram()
+{
+    if (next_datagram >= stripe_to_send.size())
+    {
+        stripe_to_send.clear();
+        next_datagram = 0;
+        tmr->stop();
+        emit stripeSent();
+        return;
+    }
+
+    if (gso_segments > 1)
+    {
+        int segment_size = stripe_to_send[next_datagram].size();
+        int total_size = 0;
+        QVector<QByteArray> segments;
+        for (int i = next_datagram; i < stripe_to_send.size() &&
+             segments.size() < int(gso_segments); i++)
+        {
+            int size = stripe_to_send[i].size();
+            if (size > segment_size ||
+                    total_size + size > UdpOffload::max_buffer_size)
+            {
+                break;
+            }
+            segments.append(stripe_to_send[i]);
+            total_size += size;
+            if (size < segment_size)
+            {
+                break;
+            }
+        }
+
+        if (Tracer::isEnabled())
+        {
+            for (auto i = 0; i < segments.size(); i++)
+            {
+                TRACE_DATAGRAM_INSTANT("stripeWriteSegment", segments[i]);
+            }
+        }
+        TRACE_DATAGRAM_SCOPE("stripeWriteSegments", segments.first());
+        bool unsupported = false;
+        if (segments.size() > 1 &&
+                UdpOffload::writeSegments(_socket->socketDescriptor(),
+                                          segments, receiver.getAddress(),
+                                          receiver.getPort(),
+                                          unsupported) >= 0)
+        {
+            next_datagram += segments.size();
+            return;
+        }
+        if (unsupported)
+        {
+            gso_segments = 1;
+        }
+    }
+
+    TRACE_DATAGRAM_SCOPE("stripeWriteDatagram", stripe_to_send[next_datagram]);
+    _socket->writeDatagram(stripe_to_send[next_datagram],
+                           receiver.getAddress(),
+                           receiver.getPort());
+    next_datagram++;
+}
@@ -0,0 +1,97 @@
+#ifndef STRIPESENDER_H
+#define STRIPESENDER_H
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QNetworkDatagram>
+#include <QTimer>
+#include <QDeadlineTimer>
+#include <QVector>
+
+#include "client.h"
+#include "mytypes.h"
+#include "tracer.h"
+#include "udpoffload.h"
+#include "reassemblymanager.h"
+
+
+/**
+ * @brief Передача и прием части (полосы) файла в отдельном потоке
+ *
+ * каждый объект живет в своем потоке и имеет собственный udp сокет и таймер;
+ * сокет полосы с номером port_offset привязан к порту основного сокета +
+ * port_offset и отправляет пакеты на порт получателя + port_offset, поэтому
+ * у обоих клиентов должно быть задано одинаковое количество полос.
+ *
+ * пакеты полосы формируются в потоке полосы; когда полоса отправлена,
+ * посылается сигнал stripeSent (следующий файл UDPClient передает по полосам
+ * только после того, как все полосы предыдущего отправлены). Принятые
+ * пакеты сообщений из нескольких пакетов сразу добавляются в общую для всех
+ * полос сборку (ReassemblyManager), собранное сообщение и остальные пакеты
+ * передаются в UDPClient через сигналы. Порт отправителя принятого пакета
+ * приводится к порту его основного сокета (вычитается port_offset).
+ */
+class StripeSender : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StripeSender(const quint16 &offset,
+                          ReassemblyManager *shared_reassembly,
+                          QObject *parent = nullptr);
+
+    bool bindStripe(const QHostAddress &address, const quint16 &port);
+
+    void sendStripe(const QByteArray &data,
+                    char flag,
+                    const uint &datagram_size,
+                    const count_size &first,
+                    const count_size &count,
+                    const Client &stripe_receiver,
+                    const uint &ms,
+                    const uint &segments);
+
+    void setForwardAll(const bool &on);
+
+signals:
+    void stripeSent();
+    void partialCreated();
+    void datagramReceived(const QNetworkDatagram &datagram,
+                          const qint64 &received_ns);
+    void messageReceived(const QNetworkDatagram &datagram,
+                         const QByteArray &message);
+
+private slots:
+    void onReadyRead();
+    void sendDatagram();
+
+private:
+
+    // udp сокет полосы
+    QUdpSocket *_socket;
+
+    // таймер, для задания частоты отправки пакетов
+    QTimer *tmr;
+
+    // смещение порта полосы относительно основного сокета (1, 2, ...)
+    quint16 port_offset;
+
+    // общая для всех полос сборка входящих сообщений
+    ReassemblyManager *reassembly;
+
+    // передавать ли все принятые пакеты в UDPClient без сборки (пересылка)
+    bool forward_all;
+
+    // получатель
+    Client receiver;
+
+    // пакеты полосы, которые необходимо отправить
+    QVector<QByteArray> stripe_to_send;
+
+    // номер следующего отправляемого пакета полосы
+    int next_datagram;
+
+    // максимальное количество пакетов в одном вызове (GSO), 1 - по одному
+    uint gso_segments;
+};
+
+#endif // STRIPESENDER_H
@@ -0,0 +1,166 @@
+#include "tracer.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+
+
+namespace
+{
+
+// количество событий в кольцевом буфере одного потока
+const quint64 buffer_capacity = 1 << 16;
+
+/**
+ * @brief Кольцевой буфер событий одного потока
+ *
+ * пишет только поток-владелец; head увеличивается после записи события,
+ * поэтому при чтении видны только полностью записанные события.
+ */
+struct TraceBuffer
+{
+    TraceEvent events[buffer_capacity];
+    std::atomic<quint64> head;
+    int tid;
+};
+
+// буферы всех потоков, когда-либо писавших события
+QVector<TraceBuffer *> buffers;
+QMutex buffers_mutex;
+
+thread_local TraceBuffer *local_buffer = nullptr;
+
+TraceBuffer *localBuffer()
+{
+    if (local_buffer == nullptr)
+    {
+        QMutexLocker locker(&buffers_mutex);
+        local_buffer = new TraceBuffer;
+        local_buffer->head.store(0, std::memory_order_relaxed);
+        local_buffer->tid = buffers.size() + 1;
+        buffers.append(local_buffer);
+    }
+    return local_buffer;
+}
+
+}
+
+
+std::atomic<bool> Tracer::enabled(false);
+QElapsedTimer Tracer::clock;
+
+
+/**
+ * @brief Включение или выключение трассировки
+ * @param on - true - включить, false - выключить
+ */
+void Tracer::setEnabled(const bool &on)
+{
+    if (on && !clock.isValid())
+    {
+        clock.start();
+    }
+    enabled.store(on, std::memory_order_release);
+}
+
+
+/**
+ * @brief Текущая метка времени
+ * @return время (в микросекундах) с момента включения трассировки
+ */
+qint64 Tracer::now()
+{
+    return clock.nsecsElapsed() / 1000;
+}
+
+
+/**
+ * @brief Запись мгновенного события
+ * @param name - название события (строковый литерал)
+ * @param id - идентификатор сообщения
+ * @param seq - порядковый номер
+ */
+void Tracer::instant(const char *name, const quint64 &id, const quint64 &seq)
+{
+    TraceEvent event = {name, 'i', now(), 0, id, seq};
+    record(event);
+}
+
+
+/**
+ * @brief Запись интервала
+ * @param name - название интервала (строковый литерал)
+ * @param start_us - время начала интервала (см. now)
+ * @param id - идентификатор сообщения
+ * @param seq - порядковый номер
+ */
+void Tracer::complete(const char *name, const qint64 &start_us,
+                      const quint64 &id, const quint64 &seq)
+{
+    TraceEvent event = {name, 'X', start_us, now() - start_us, id, seq};
+    record(event);
+}
+
+
+void Tracer::record(const TraceEvent &event)
+{
+    TraceBuffer *buffer = localBuffer();
+    quint64 head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head % buffer_capacity] = event;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+
+/**
+ * @brief Сохранение событий в формате Chrome trace JSON
+ * @param file_name - название файла
+ * @return true, если файл записан, иначе - false
+ *
+ * вызывать, когда потоки, пишущие события, остановлены или простаивают:
+ * событие, перезаписываемое во время сохранения, может быть искажено.
+ */
+bool Tracer::dump(const QString &file_name)
+{
+    QFile trace_file(file_name);
+    if (!trace_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        return false;
+    }
+
+    QTextStream out(&trace_file);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+
+    QMutexLocker locker(&buffers_mutex);
+    for (auto i = 0; i < buffers.size(); i++)
+    {
+        TraceBuffer *buffer = buffers[i];
+        quint64 head = buffer->head.load(std::memory_order_acquire);
+        quint64 begin = (head > buffer_capacity) ? head - buffer_capacity : 0;
+        for (quint64 j = begin; j < head; j++)
+        {
+            const TraceEvent &event = buffer->events[j % buffer_capacity];
+            out << (first ? "\n" : ",\n");
+            first = false;
+            out << "{\"name\":\"" << event.name << "\",\"ph\":\""
+                << event.phase << "\",\"ts\":" << event.ts_us;
+            if (event.phase == 'X')
+            {
+                out << ",\"dur\":" << event.dur_us;
+            }
+            else
+            {
+                out << ",\"s\":\"t\"";
+            }
+            out << ",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"args\":{\"id\":" << event.id
+                << ",\"seq\":" << event.seq << "}}";
+        }
+    }
+    out << "\n]}\n";
+    out.flush();
+
+    return trace_file.error() == QFile::NoError;
+}
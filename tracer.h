@@ -0,0 +1,101 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QString>
+#include <QElapsedTimer>
+#include <atomic>
+
+
+/**
+ * @brief Событие трассировки
+ *
+ * phase - 'X' (интервал, dur_us - длительность) или 'i' (мгновенное событие);
+ * у событий пакетов id и seq - общее количество пакетов сообщения и
+ * порядковый номер пакета из заголовка (одинаковые у отправителя и
+ * получателя), у событий сообщений id - размер сообщения в байтах, seq - 0
+ * (у полосы - номер ее первого пакета).
+ */
+struct TraceEvent
+{
+    const char *name;
+    char phase;
+    qint64 ts_us;
+    qint64 dur_us;
+    quint64 id;
+    quint64 seq;
+};
+
+
+/**
+ * @brief Трассировка жизненного цикла пакетов
+ *
+ * выключена по умолчанию; при выключенной трассировке каждая точка стоит одну
+ * атомарную загрузку. События пишутся в кольцевой буфер своего потока без
+ * блокировок (мьютекс берется только при первом событии потока); при
+ * переполнении старые события перезаписываются. Результат сохраняется в
+ * формате Chrome trace JSON (открывается в chrome://tracing и Perfetto UI).
+ */
+class Tracer
+{
+public:
+    static void setEnabled(const bool &on);
+
+    static inline bool isEnabled(void)
+    {
+        return enabled.load(std::memory_order_acquire);
+    }
+
+    static qint64 now(void);
+
+    static void instant(const char *name, const quint64 &id,
+                        const quint64 &seq);
+    static void complete(const char *name, const qint64 &start_us,
+                         const quint64 &id, const quint64 &seq);
+
+    static bool dump(const QString &file_name);
+
+private:
+    static void record(const TraceEvent &event);
+
+    // включена ли трассировка
+    static std::atomic<bool> enabled;
+
+    // часы, от которых отсчитываются метки времени событий
+    static QElapsedTimer clock;
+};
+
+
+/**
+ * @brief Интервал трассировки от создания до уничтожения объекта
+ */
+class TraceScope
+{
+public:
+    inline TraceScope(const char *name, const quint64 &id, const quint64 &seq)
+        : _name(name), _id(id), _seq(seq),
+          _start(Tracer::isEnabled() ? Tracer::now() : -1)
+    {
+    }
+
+    inline ~TraceScope()
+    {
+        if (_start >= 0)
+        {
+            Tracer::complete(_name, _start, _id, _seq);
+        }
+    }
+
+private:
+    const char *_name;
+    quint64 _id;
+    quint64 _seq;
+    qint64 _start;
+};
+
+
+#define TRACE_SCOPE(name, id, seq) TraceScope trace_scope(name, id, seq)
+
+#define TRACE_INSTANT(name, id, seq) \
+    do { if (Tracer::isEnabled()) Tracer::instant(name, id, seq); } while (0)
+
+#endif // TRACER_H
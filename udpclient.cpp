@@ -4,272 +4,1390 @@
 UDPClient::UDPClient(QObject *parent) : QObject(parent)
 {
     connect(&_socket, &QUdpSocket::readyRead, this, &UDPClient::onReadyRead);
-    metadata_size = 9;
-    byte_count_size = 4;
 
     file_name_size = 260;
 
+    stripe_count = 1;
+    stripes_bound = false;
+    stripes_in_flight = 0;
+
+    gso_segments = 1;
+    gro_fd = -1;
+    gro_notifier = nullptr;
+
+    weight[CONTROL] = 0;
+    weight[INTERACTIVE] = 4;
+    weight[BULK] = 1;
+    for (auto i = 0; i < CLASS_COUNT; i++)
+    {
+        deficit[i] = 0;
+    }
+    drr_class = INTERACTIVE;
+
+    relay_stats.forwarded = 0;
+    relay_stats.latency_total_ns = 0;
+    relay_stats.latency_max_ns = 0;
+
+    dedup = false;
+    offer_timeout = 2000;
+
+    reassembly_tmr = new QTimer(this);
+    reassembly_tmr->setInterval(1000);
+    connect(reassembly_tmr, &QTimer::timeout,
+            this, &UDPClient::evictExpiredMessages);
+
+    linger = 0;
+    pending_size = 0;
+    linger_tmr = new QTimer(this);
+    linger_tmr->setSingleShot(true);
+    connect(linger_tmr, &QTimer::timeout,
+            this, &UDPClient::flushSmallMessages);
+
+    interval = 100;
     tmr = new QTimer(this);
+    tmr->setSingleShot(true);
+    pacing_start = -1;
     connect(tmr, &QTimer::timeout, this, &UDPClient::sendDatagram);
-    tmr->start(100);
 }
 
 
-UDPClient::~UDPClient()
+UDPClient::~UDPClient()
+{
+    stopStripes();
+    if (gro_fd >= 0)
+    {
+        delete gro_notifier;
+        UdpOffload::release(gro_fd);
+    }
+    delete reassembly_tmr;
+    delete linger_tmr;
+    delete tmr;
+}
+
+
+/**
+ * @brief Установление размера передаваемого пакета
+ * @param d_size - размер пакета
+ *
+ * размер передаваемой информации в пакете + размер служебной информации -
+ * передаваемый d_size
+ */
+void UDPClient::setDatagramSize(uint &d_size)
+{
+    if (d_size > 0)
+    {
+        datagram_size = d_size - Header::size;
+    }
+}
+
+
+/**
+ * @brief Привязка сокета к адресу
+ * @param ip_addr - адрес ipv4
+ * @param port - порт
+ * @return true, если связывание прошло успешно, иначе - false
+ */
+bool UDPClient::bindLocal(const QString &ip_addr, const quint16 &port)
+{
+    bool connected = false;
+    if (_socket.state() != _socket.BoundState)
+    {
+        connected = _socket.bind(QHostAddress(ip_addr), port);
+    }
+    if (connected && gso_segments > 1)
+    {
+        enableOffload();
+    }
+    if (connected)
+    {
+        bindStripes();
+    }
+    return connected;
+}
+
+
+/**
+ * @brief Сохранение адреса получателя
+ * @param ip_addr - адрес ipv4
+ * @param port - порт
+ * @return true, если входные данные корректные, иначе - false
+ */
+bool UDPClient::connectTo(const QString &ip_addr, const quint16 &port)
+{
+    bool connected = false;
+    if (port != 0)
+    {
+        receiver.setAddress(QHostAddress(ip_addr));
+        receiver.setPort(port);
+        connected = true;
+    }
+    return connected;
+}
+
+
+/**
+ * @brief Передача сообщения
+ * @param message - текст сообщения
+ * @return true, если сообщение отправлено (или ожидает отправки), false -
+ * если количество пакетов сообщения не помещается в счетчик заголовка
+ *
+ * иходное тескствое сообщение конвертируется в массив байт и отправляется;
+ * короткое сообщение (помещающееся в пакет вместе с заголовком длины)
+ * отправляется сразу, если очередь пуста и интервал с прошлой отправки истек;
+ * иначе короткие сообщения в течение linger мс накапливаются и отправляются
+ * одним пакетом.
+ *
+ */
+bool UDPClient::sendMessage(const QString &message)
+{
+    QByteArray ba_message = message.toUtf8();
+    uint sub_size = ba_message.size() + Header::count_digits;
+
+    // количество пакетов должно помещаться в счетчик заголовка
+    if (OutgoingMessage::countDatagrams(ba_message.size(), datagram_size) >
+            Header::max_count)
+    {
+        return false;
+    }
+
+    if (linger == 0 || ba_message.isEmpty() || sub_size > datagram_size ||
+            (pending_small.isEmpty() && !hasPendingDatagrams() &&
+             isPacerReady()))
+    {
+        flushSmallMessages();
+        sendByteData(ba_message);
+        return true;
+    }
+
+    if (pending_size + sub_size > datagram_size)
+    {
+        flushSmallMessages();
+    }
+
+    pending_small.append(ba_message);
+    pending_size += sub_size;
+    if (!linger_tmr->isActive())
+    {
+        linger_tmr->start(linger);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Передача файла
+ * @param file_name - название файла (полный путь)
+ * @return true, если файл был отправлен, false, если произошла ошибка
+ *
+ * файл считывается полностью как последовательность байт (ограничение размера
+ * файла - 2ГБ);
+ * собственно название файла должно быть меньше 260 байт.
+ *
+ * если включена дедупликация, сначала отправляется предложение: хэш
+ * содержимого и название файла. Если у получателя уже есть такой файл, он
+ * создает его у себя и сразу отвечает; иначе (или если ответа нет в течение
+ * offer_timeout) файл передается полностью. Получателю, который не ответил
+ * на предложение (не поддерживает предложения, см. offerTimedOut), следующие
+ * файлы передаются сразу.
+ *
+ * предложение оформлено как первый пакет сообщения из двух пакетов: клиент
+ * без поддержки предложений только сохраняет его как часть сообщения (не
+ * показывает и не отправляет квитанцию), а следующее его сообщение
+ * замещает этот пакет.
+ */
+bool UDPClient::sendFile(const QString &file_name)
+{
+    QByteArray file_byte_data = formFileByteData(file_name);
+    if (file_byte_data.isEmpty())
+    {
+        return false;
+    }
+
+    // количество пакетов должно помещаться в счетчик заголовка
+    quint64 count = (quint64(file_byte_data.size()) + datagram_size - 1) /
+            datagram_size;
+    if (count > Header::max_count)
+    {
+        return false;
+    }
+
+    if (!dedup || legacy_peers.contains(receiver.formPrettyAddress()))
+    {
+        sendFileData(file_byte_data);
+        return true;
+    }
+
+    // хэш считается только для предложения, по данным без названия и без
+    // их копирования
+    QByteArray name_b = file_byte_data.left(file_name_size);
+    name_b.truncate(name_b.indexOf('\0'));
+    QByteArray file_digest = ContentStore::digest(
+                file_byte_data.constData() + file_name_size,
+                file_byte_data.size() - file_name_size);
+    QByteArray offer = file_digest + name_b;
+
+    if (uint(offer.size()) > datagram_size ||
+            offered_files.contains(file_digest))
+    {
+        sendFileData(file_byte_data);
+        return true;
+    }
+
+    offered_files.insert(file_digest, file_byte_data);
+    offer_peers.insert(file_digest, receiver.formPrettyAddress());
+    QByteArray datagram = Header::encode(Header::flags::offer, 2, 0);
+    datagram.append(offer);
+    enqueueDatagram(CONTROL, datagram, receiver);
+    scheduleSend();
+    QTimer::singleShot(offer_timeout, this, [this, file_digest]()
+    {
+        offerTimedOut(file_digest);
+    });
+    return true;
+}
+
+
+/**
+ * @brief Передача данных файла (по полосам или через общую очередь)
+ * @param file_byte_data - данные файла вместе с названием
+ */
+void UDPClient::sendFileData(const QByteArray &file_byte_data)
+{
+    if (stripe_count > 1 && stripes_bound)
+    {
+        sendStriped(file_byte_data);
+    }
+    else
+    {
+        sendByteData(file_byte_data, true);
+    }
+}
+
+
+/**
+ * @brief Передача предложенного файла полностью
+ * @param file_digest - хэш содержимого файла
+ *
+ * ничего не делает, если на предложение уже ответили
+ */
+void UDPClient::sendOfferedFile(const QByteArray &file_digest)
+{
+    QByteArray file_byte_data = offered_files.take(file_digest);
+    offer_peers.remove(file_digest);
+    if (!file_byte_data.isEmpty())
+    {
+        sendFileData(file_byte_data);
+    }
+}
+
+
+/**
+ * @brief Слот срабатывает, если на предложение файла нет ответа в течение
+ * offer_timeout
+ * @param file_digest - хэш содержимого файла
+ *
+ * файл передается полностью; получатель считается не поддерживающим
+ * предложения (пока от него не придет ответ на предложение), и следующие
+ * файлы ему передаются без предложения. Если предложение было потеряно,
+ * теряется только дедупликация для этого получателя.
+ */
+void UDPClient::offerTimedOut(const QByteArray &file_digest)
+{
+    if (!offered_files.contains(file_digest))
+    {
+        return;
+    }
+    legacy_peers.insert(offer_peers.value(file_digest));
+    sendOfferedFile(file_digest);
+}
+
+
+/**
+ * @brief Включение/выключение предложения файлов по хэшу
+ * @param on - true - предлагать файл перед передачей и сохранять полученные
+ * файлы в хранилище, false - передавать сразу (по умолчанию)
+ */
+void UDPClient::setDedup(const bool &on)
+{
+    dedup = on;
+}
+
+
+/**
+ * @brief Установка каталога хранилища полученных файлов
+ * @param dir - путь к каталогу
+ */
+void UDPClient::setStoreDirectory(const QString &dir)
+{
+    store.setDirectory(dir);
+}
+
+
+/**
+ * @brief Установка интервала отправки пакетов
+ * @param ms - временной интервал (в миллисекундах)
+ *
+ */
+void UDPClient::setInterval(const uint &ms)
+{
+    interval = ms;
+}
+
+
+/**
+ * @brief Получение минимального размера пакета, исходя из размера служебной
+ * информации
+ * @return минимальный размер пакета данных
+ */
+uint UDPClient::getMinDatagramSize()
+{
+    return Header::size + 1;
+}
+
+
+/**
+ * @brief Установка времени ожидания для объединения коротких сообщений
+ * @param ms - время ожидания (в миллисекундах), 0 - не объединять (по
+ * умолчанию)
+ *
+ * получатель должен поддерживать пакеты с несколькими сообщениями; на такой
+ * пакет приходит одна квитанция о доставке (см. messageDelivered).
+ */
+void UDPClient::setLinger(const uint &ms)
+{
+    linger = ms;
+    if (linger == 0)
+    {
+        flushSmallMessages();
+    }
+}
+
+
+/**
+ * @brief Установка весов классов трафика
+ * @param interactive - вес текстовых сообщений
+ * @param bulk - вес файлов
+ *
+ * при одновременной передаче текста и файла пропускная способность делится
+ * пропорционально весам; квитанции отправляются сразу, вне очередей.
+ */
+void UDPClient::setWeights(const uint &interactive, const uint &bulk)
+{
+    if (interactive > 0 && bulk > 0)
+    {
+        weight[INTERACTIVE] = interactive;
+        weight[BULK] = bulk;
+    }
+}
+
+
+/**
+ * @brief Включение сегментации пакетов файлов (GSO/GRO, только Linux)
+ * @param segments - максимальное количество пакетов в одном вызове,
+ * 1 - отключить отправку через GSO
+ *
+ * за один интервал отправки передается до segments пакетов файла одним
+ * системным вызовом; прием с объединением пакетов (GRO) включается при
+ * привязке сокета (bindLocal) и остается включенным. Если ядро не
+ * поддерживает сегментацию, клиент возвращается к обычной отправке.
+ */
+void UDPClient::setOffload(const uint &segments)
+{
+    if (segments == 0)
+    {
+        return;
+    }
+    gso_segments = qMin(segments, uint(UdpOffload::max_segments));
+    if (gso_segments > 1 && _socket.state() == _socket.BoundState)
+    {
+        enableOffload();
+    }
+}
+
+
+/**
+ * @brief Включение приема с объединением пакетов и проверка поддержки
+ * сегментации при отправке
+ *
+ * поддержка GSO проверяется один раз при включении; если ее нет, файлы
+ * отправляются по одному пакету.
+ */
+void UDPClient::enableOffload()
+{
+    enableGroReceive();
+    if (!UdpOffload::supportsGso(_socket.socketDescriptor()))
+    {
+        gso_segments = 1;
+    }
+}
+
+
+/**
+ * @brief Включение приема с объединением пакетов (GRO)
+ *
+ * объединенные буферы нельзя читать через QUdpSocket (размер сегмента
+ * теряется), поэтому чтение идет через дубликат дескриптора со своим
+ * уведомителем, а readyRead сокета больше не обрабатывается.
+ */
+void UDPClient::enableGroReceive()
+{
+    if (gro_fd >= 0 || !UdpOffload::enableGro(_socket.socketDescriptor()))
+    {
+        return;
+    }
+
+    gro_fd = UdpOffload::duplicate(_socket.socketDescriptor());
+    if (gro_fd < 0)
+    {
+        return;
+    }
+
+    disconnect(&_socket, &QUdpSocket::readyRead,
+               this, &UDPClient::onReadyRead);
+    gro_notifier = new QSocketNotifier(gro_fd, QSocketNotifier::Read, this);
+    connect(gro_notifier, &QSocketNotifier::activated,
+            this, &UDPClient::onOffloadReadyRead);
+}
+
+
+/**
+ * @brief Установка ограничений сборки входящих сообщений
+ * @param budget - общий бюджет памяти на частично собранные сообщения (байты)
+ * @param quota - квота памяти на одного отправителя (байты)
+ * @param timeout_ms - время ожидания следующего пакета сообщения (мс)
+ */
+void UDPClient::setReassemblyLimits(const qint64 &budget, const qint64 &quota,
+                                    const qint64 &timeout_ms)
+{
+    reassembly.setLimits(budget, quota, timeout_ms);
+}
+
+
+/**
+ * @brief Получение статистики сборки входящих сообщений
+ * @return количество удаленных частично собранных сообщений (по времени
+ * ожидания, из-за памяти, замененных), отброшенных пакетов и текущий объем
+ * памяти
+ */
+ReassemblyStats UDPClient::getReassemblyStats() const
+{
+    return reassembly.getStats();
+}
+
+
+/**
+ * @brief Слот периодической проверки устаревших входящих сообщений
+ */
+void UDPClient::evictExpiredMessages()
+{
+    reassembly.evictExpired();
+    if (reassembly.isEmpty())
+    {
+        reassembly_tmr->stop();
+    }
+}
+
+
+/**
+ * @brief Добавление маршрута пересылки
+ * @param source - отправитель, порт 0 - любой порт этого адреса
+ * @param destination - получатель пересылаемых пакетов
+ *
+ * пакеты отправителя, для которого есть маршрут, не собираются в сообщения,
+ * а сразу пересылаются получателю. Для пересылки квитанций о доставке
+ * нужен и обратный маршрут (от получателя к отправителю).
+ */
+void UDPClient::addRoute(const Client &source, const Client &destination)
+{
+    routes.insert(source.formPrettyAddress(), destination);
+    for (auto i = 0; i < stripe_senders.size(); i++)
+    {
+        StripeSender *sender = stripe_senders[i];
+        QMetaObject::invokeMethod(sender, [sender]()
+        {
+            sender->setForwardAll(true);
+        }, Qt::QueuedConnection);
+    }
+}
+
+
+/**
+ * @brief Удаление маршрута пересылки
+ * @param source - отправитель (как в addRoute)
+ */
+void UDPClient::removeRoute(const Client &source)
+{
+    routes.remove(source.formPrettyAddress());
+    bool forward_all = !routes.isEmpty();
+    for (auto i = 0; i < stripe_senders.size(); i++)
+    {
+        StripeSender *sender = stripe_senders[i];
+        QMetaObject::invokeMethod(sender, [sender, forward_all]()
+        {
+            sender->setForwardAll(forward_all);
+        }, Qt::QueuedConnection);
+    }
+}
+
+
+/**
+ * @brief Статистика пересылки пакетов
+ * @return количество пересланных пакетов и время от приема до пересылки
+ */
+RelayStats UDPClient::getRelayStats() const
+{
+    return relay_stats;
+}
+
+
+/**
+ * @brief Пересылка пакета по таблице маршрутов
+ * @param n_datagram - входящий пакет
+ * @param received_ns - время приема пакета (QDeadlineTimer::current, нс)
+ * @return true, если для отправителя есть маршрут и пакет переслан,
+ * иначе - false
+ *
+ * пакет пересылается сразу после приема, без сборки сообщения и без очереди
+ * отправки; данные пакета не копируются (QByteArray с общими данными).
+ * Заголовок пакета не содержит адресов, поэтому не изменяется - новым
+ * отправителем для получателя становится сокет этого клиента.
+ *
+ * время от приема до отправки (задержка на узле, включая ожидание в цикле
+ * событий и передачу из потока полосы) учитывается в RelayStats и
+ * записывается в трассу интервалом "relayHop".
+ */
+bool UDPClient::relayDatagram(const QNetworkDatagram &n_datagram,
+                              const qint64 &received_ns)
+{
+    Client source(n_datagram.senderAddress(), n_datagram.senderPort());
+    auto route = routes.constFind(source.formPrettyAddress());
+    if (route == routes.constEnd())
+    {
+        source.setPort(0);
+        route = routes.constFind(source.formPrettyAddress());
+        if (route == routes.constEnd())
+        {
+            return false;
+        }
+    }
+
+    _socket.writeDatagram(n_datagram.data(), route->getAddress(),
+                          route->getPort());
+
+    qint64 hop_ns = QDeadlineTimer::current(Qt::PreciseTimer).deadlineNSecs()
+            - received_ns;
+    relay_stats.forwarded++;
+    relay_stats.latency_total_ns += hop_ns;
+    relay_stats.latency_max_ns = qMax(relay_stats.latency_max_ns, hop_ns);
+    if (Tracer::isEnabled())
+    {
+        DatagramTraceKey key = OutgoingMessage::traceKey(n_datagram.data());
+        Tracer::complete("relayHop", Tracer::now() - hop_ns / 1000,
+                         key.total, key.position);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Установка количества полос для параллельной передачи файлов
+ * @param count - количество полос (1 - передача без разделения)
+ *
+ * для каждой полосы создается отдельный поток со своим сокетом и таймером;
+ * сокет полосы i (1 .. count) привязывается к порту основного сокета + i,
+ * принимает пакеты полос отправителя и отправляет свои пакеты на порт
+ * получателя + i. Количество полос у отправителя и получателя должно
+ * совпадать. Прежние потоки завершаются (неотправленные пакеты прежних
+ * полос теряются).
+ */
+void UDPClient::setStripeCount(const uint &count)
+{
+    if (count == 0 || count == stripe_count)
+    {
+        return;
+    }
+
+    stopStripes();
+    stripe_count = count;
+    if (stripe_count == 1)
+    {
+        return;
+    }
+
+    bool forward_all = !routes.isEmpty();
+    for (uint i = 0; i < stripe_count; i++)
+    {
+        QThread *thread = new QThread(this);
+        StripeSender *sender = new StripeSender(i + 1, &reassembly);
+        sender->setForwardAll(forward_all);
+        sender->moveToThread(thread);
+        connect(thread, &QThread::finished, sender, &QObject::deleteLater);
+        connect(sender, &StripeSender::datagramReceived,
+                this, &UDPClient::onStripeDatagram);
+        connect(sender, &StripeSender::messageReceived,
+                this, &UDPClient::onStripeMessage);
+        connect(sender, &StripeSender::stripeSent,
+                this, &UDPClient::onStripeSent);
+        connect(sender, &StripeSender::partialCreated,
+                this, &UDPClient::onStripePartial);
+        thread->start();
+
+        stripe_threads.append(thread);
+        stripe_senders.append(sender);
+    }
+
+    if (_socket.state() == _socket.BoundState)
+    {
+        bindStripes();
+    }
+}
+
+
+/**
+ * @brief Привязка сокетов полос к портам, следующим за портом основного
+ * сокета
+ * @return true, если привязаны сокеты всех полос, иначе - false
+ *
+ * привязка выполняется в потоках полос, основной поток ждет ее завершения.
+ */
+bool UDPClient::bindStripes()
+{
+    QHostAddress address = _socket.localAddress();
+    quint16 port = _socket.localPort();
+    stripes_bound = !stripe_senders.isEmpty();
+    for (auto i = 0; i < stripe_senders.size(); i++)
+    {
+        StripeSender *sender = stripe_senders[i];
+        bool bound = false;
+        QMetaObject::invokeMethod(sender, [sender, address, port]()
+        {
+            return sender->bindStripe(address, port);
+        }, Qt::BlockingQueuedConnection, &bound);
+        stripes_bound = stripes_bound && bound;
+    }
+    return stripes_bound;
+}
+
+
+/**
+ * @brief Слот срабатывает, если есть доступные для чтения пакеты
+ *
+ * принимаются пакеты, пока есть доступные,
+ * из каждого извлекаестя порядковый номер и общее количество
+ * далее пакеты помещаются в ассоциативный массив, ключом которого является
+ * порядковый номер, а значением - содержимое пакета (см. ReassemblyManager)
+ *
+ * далее если дошли не все пакеты, то ждем, пока дойдут все (но не дольше
+ * времени ожидания и в пределах ограничений памяти),
+ * если все пакеты дошли, то формируется сообщение из пакетов по порядку;
+ * если пришел файл, то из сообщения извлекается название файла, а сам файл
+ * записывается в рабочую директорию.
+ * также отправляется информация о том, что сообщение было доставлено.
+ *
+ */
+void UDPClient::onReadyRead()
+{
+    while (_socket.hasPendingDatagrams())
+    {
+        // время приема нужно только для статистики пересылки
+        qint64 received_ns = routes.isEmpty() ? 0 :
+                QDeadlineTimer::current(Qt::PreciseTimer).deadlineNSecs();
+        processIncomingDatagram(
+                    _socket.receiveDatagram(_socket.pendingDatagramSize()),
+                    received_ns);
+    }
+}
+
+
+/**
+ * @brief Слот срабатывает, если есть данные при приеме с объединением пакетов
+ *
+ * объединенные ядром буферы делятся на исходные пакеты, которые далее
+ * обрабатываются так же, как в onReadyRead.
+ */
+void UDPClient::onOffloadReadyRead()
+{
+    QVector<QNetworkDatagram> datagrams;
+    qint64 received_ns = routes.isEmpty() ? 0 :
+            QDeadlineTimer::current(Qt::PreciseTimer).deadlineNSecs();
+    UdpOffload::readSegments(gro_fd, datagrams);
+    for (auto i = 0; i < datagrams.size(); i++)
+    {
+        processIncomingDatagram(datagrams[i], received_ns);
+    }
+}
+
+
+/**
+ * @brief Обработка одного входящего пакета
+ * @param n_datagram - пакет
+ * @param received_ns - время приема пакета (для статистики пересылки)
+ */
+void UDPClient::processIncomingDatagram(const QNetworkDatagram &n_datagram,
+                                        const qint64 &received_ns)
+{
+    IncomingDatagram datagram;
+    QByteArray message;
+
+    if (!routes.isEmpty() && relayDatagram(n_datagram, received_ns))
+    {
+        return;
+    }
+
+    datagram.processDatagram(n_datagram);
+    if (!datagram.isValid())
+    {
+        return;
+    }
+    TRACE_INSTANT("receiveDatagram", datagram.getTotalCount(),
+                  datagram.getPosition());
+
+    if (datagram.isDelivered())
+    {
+        emit messageDelivered(datagram.getSender());
+        return;
+    }
+
+    if (datagram.isBatch())
+    {
+        processBatch(datagram);
+        return;
+    }
+
+    if (datagram.isOffer())
+    {
+        processOffer(datagram);
+        return;
+    }
+
+    if (datagram.isOfferReply())
+    {
+        processOfferReply(datagram);
+        return;
+    }
+
+    bool complete = reassembly.insert(datagram, message);
+    if (!reassembly.isEmpty() && !reassembly_tmr->isActive())
+    {
+        reassembly_tmr->start();
+    }
+    if (complete)
+    {
+        processMessage(datagram, message);
+    }
+}
+
+
+/**
+ * @brief Обработка собранного входящего сообщения
+ * @param datagram - последний пакет сообщения
+ * @param message - сообщение целиком
+ *
+ * текст показывается, файл записывается в рабочую директорию, отправителю
+ * отправляется квитанция о доставке.
+ */
+void UDPClient::processMessage(const IncomingDatagram &datagram,
+                               const QByteArray &message)
+{
+    if (!datagram.isFile())
+    {
+        emit newMessage(datagram.getSender(), processIncomingText(message));
+    }
+    else
+    {
+        emit newMessage(datagram.getSender(), processIncomingFile(message));
+    }
+
+    sendDeliveredAnswer(datagram.getSender(), datagram.getTotalCount());
+}
+
+
+/**
+ * @brief Обработка предложения файла по хэшу
+ * @param datagram - входящий пакет: хэш содержимого (64 байта) и название
+ *
+ * если файл с таким содержимым есть в хранилище, он создается с указанным
+ * названием; отправителю отвечает пакет: '1' (файл создан) или '0' и хэш.
+ * Предложения с некорректным хэшем (см. ContentStore::isDigest)
+ * отбрасываются без ответа.
+ */
+void UDPClient::processOffer(const IncomingDatagram &datagram)
+{
+    QByteArray data = datagram.getData();
+    QByteArray file_digest = data.left(64);
+    if (data.size() <= 64 || !ContentStore::isDigest(file_digest))
+    {
+        return;
+    }
+
+    QString file_name = receivedFileName(data.mid(64));
+    bool have = dedup && !file_name.isEmpty() &&
+            store.materialize(file_digest, file_name);
+    if (have)
+    {
+        emit newMessage(datagram.getSender(),
+                        "Вы получили файл: " + file_name);
+    }
+
+    QByteArray answer;
+    answer.append(have ? '1' : '0');
+    answer.append(file_digest);
+    enqueueDatagram(CONTROL,
+                    formServiceDatagram(Header::flags::offer_reply, answer),
+                    datagram.getSender());
+    scheduleSend();
+}
+
+
+/**
+ * @brief Обработка ответа на предложение файла
+ * @param datagram - входящий пакет: '1' или '0' и хэш содержимого
+ *
+ * если получатель создал файл у себя, передача считается завершенной,
+ * иначе файл передается полностью.
+ */
+void UDPClient::processOfferReply(const IncomingDatagram &datagram)
+{
+    // ответ означает, что отправитель поддерживает предложения
+    legacy_peers.remove(datagram.getSender().formPrettyAddress());
+
+    QByteArray data = datagram.getData();
+    QByteArray file_digest = data.mid(1);
+    if (data.isEmpty() || !offered_files.contains(file_digest))
+    {
+        return;
+    }
+
+    if (data[0] == '1')
+    {
+        offered_files.remove(file_digest);
+        offer_peers.remove(file_digest);
+        emit messageDelivered(datagram.getSender());
+    }
+    else
+    {
+        sendOfferedFile(file_digest);
+    }
+}
+
+
+/**
+ * @brief Обработка пакета с несколькими короткими сообщениями
+ * @param datagram - входящий пакет
+ *
+ * каждое сообщение в пакете предваряется своей длиной (Header::count_digits
+ * байт); на весь пакет отправляется одна квитанция о доставке (как на
+ * сообщение из одного пакета).
+ */
+void UDPClient::processBatch(const IncomingDatagram &datagram)
+{
+    bool ok;
+    QByteArray data = datagram.getData();
+    Client sender = datagram.getSender();
+    count_size offset = 0;
+    count_size data_size = data.size();
+    count_size received = 0;
+
+    while (offset + Header::count_digits <= data_size)
+    {
+        count_size length = Header::loadCount(data.constData() + offset, ok);
+        offset += Header::count_digits;
+        if (!ok || offset + length > data_size)
+        {
+            break;
+        }
+
+        emit newMessage(sender, processIncomingText(data.mid(offset, length)));
+        offset += length;
+        received++;
+    }
+
+    if (received > 0)
+    {
+        sendDeliveredAnswer(sender, 1);
+    }
+}
+
+
+/**
+ * @brief Формирование пакета в случае успешной доставки сообщения
+ * @param count - кодичество пакетов доставленного сообщения
+ * @return "служебный пакет" -
+ * общее количество пакетов равно порядковому номеру = количеству пакетов
+ */
+QByteArray UDPClient::formDeliveredAnswer(const count_size &count)
 {
-    delete tmr;
+    QByteArray answer = Header::encode(Header::flags::text, count, count);
+    answer.append("/0");
+    return answer;
 }
 
 
 /**
- * @brief Установление размера передаваемого пакета
- * @param d_size - размер пакета
+ * @brief Разделение бинарных данных на пакеты
+ * @param ba_message - данные (массив байт)
+ * @param is_file - флаг: true - передаваемые данные файл,
+ * иначе - обычное текстовое сообщение
+ * @return пакеты сообщения по порядку (пусто, если количество пакетов не
+ * помещается в счетчик заголовка)
  *
- * размер передаваемой информации в пакете + размер служебной информации -
- * передаваемый d_size
+ * исходные данные разделяются на пакеты размером datagram_size, в начало
+ * каждого пакета записывается заголовок: флаг файла, общее количество
+ * пакетов, на которое разделилось исходное сообщение, и порядковый номер
+ * пакета
  */
-void UDPClient::setDatagramSize(uint &d_size)
+QVector<QByteArray> UDPClient::formDatagrams(const QByteArray &ba_message,
+                                             bool is_file)
 {
-    if (d_size > 0)
+    quint64 count = OutgoingMessage::countDatagrams(ba_message.size(),
+                                                    datagram_size);
+    char flag = is_file ? Header::flags::file : Header::flags::text;
+
+    if (count > Header::max_count)
     {
-        datagram_size = d_size - metadata_size;
+        return QVector<QByteArray>();
     }
+    return OutgoingMessage::formDatagrams(ba_message, flag, datagram_size,
+                                          0, count);
 }
 
 
 /**
- * @brief Привязка сокета к адресу
- * @param ip_addr - адрес ipv4
- * @param port - порт
- * @return true, если связывание прошло успешно, иначе - false
+ * @brief Передача бинарных данных
+ * @param ba_message - данные (массив байт)
+ * @param is_file - флаг: true - передаваемые данные файл,
+ * иначе - обычное текстовое сообщение
+ *
+ * пакеты сообщения ставятся в общую очередь отправки
  */
-bool UDPClient::bindLocal(const QString &ip_addr, const quint16 &port)
+void UDPClient::sendByteData(const QByteArray &ba_message, bool is_file)
 {
-    bool connected = false;
-    if (_socket.state() != _socket.BoundState)
+    TRACE_SCOPE("sendByteData", ba_message.size(), 0);
+    lates_message = formDatagrams(ba_message, is_file);
+    for (auto i = 0; i < lates_message.size(); i++)
     {
-        connected = _socket.bind(QHostAddress(ip_addr), port);
+        enqueueDatagram(is_file ? BULK : INTERACTIVE, lates_message[i],
+                        receiver);
     }
-    return connected;
+    scheduleSend();
 }
 
 
 /**
- * @brief Сохранение адреса получателя
- * @param ip_addr - адрес ipv4
- * @param port - порт
- * @return true, если входные данные корректные, иначе - false
+ * @brief Отправка квитанции о доставке сообщения
+ * @param sender - отправитель доставленного сообщения
+ * @param count - количество пакетов доставленного сообщения
+ *
+ * квитанция отправляется сразу, без очереди и без ожидания интервала
+ * отправки, чтобы не занимать интервалы собственных сообщений клиента.
  */
-bool UDPClient::connectTo(const QString &ip_addr, const quint16 &port)
+void UDPClient::sendDeliveredAnswer(const Client &sender,
+                                    const count_size &count)
 {
-    bool connected = false;
-    if (port != 0)
-    {
-        receiver.setAddress(QHostAddress(ip_addr));
-        receiver.setPort(port);
-        connected = true;
-    }
-    return connected;
+    TRACE_INSTANT("writeDeliveredAnswer", count, count);
+    _socket.writeDatagram(formDeliveredAnswer(count), sender.getAddress(),
+                          sender.getPort());
 }
 
 
 /**
- * @brief Передача сообщения
- * @param message - текст сообщения
- *
- * иходное тескствое сообщение конвертируется в массив байт и отправляется
- *
+ * @brief Постановка пакета в очередь своего класса трафика
+ * @param traffic_class - класс трафика
+ * @param data - пакет
+ * @param destination - получатель пакета
  */
-void UDPClient::sendMessage(const QString &message)
+void UDPClient::enqueueDatagram(const int &traffic_class,
+                                const QByteArray &data,
+                                const Client &destination)
 {
-    QByteArray ba_message = message.toUtf8();
-    sendByteData(ba_message);
+    message_to_send[traffic_class].enqueue(
+                QNetworkDatagram(data, destination.getAddress(),
+                                 destination.getPort()));
+    TRACE_DATAGRAM_INSTANT("enqueue", data);
 }
 
 
 /**
- * @brief Передача файла
- * @param file_name - название файла (полный путь)
- * @return true, если файл был отправлен, false, если произошла ошибка
- *
- * файл считывается полностью как последовательность байт (ограничение размера
- * файла - 2ГБ);
- * собственно название файла должно быть меньше 260 байт.
+ * @brief Проверка, есть ли пакеты в очередях отправки
+ * @return true, если хотя бы одна очередь не пуста, иначе - false
  */
-bool UDPClient::sendFile(const QString &file_name)
+bool UDPClient::hasPendingDatagrams() const
 {
-    QByteArray file_byte_data = formFileByteData(file_name);
-    if (file_byte_data.isEmpty())
+    for (auto i = 0; i < CLASS_COUNT; i++)
     {
-        return false;
+        if (!message_to_send[i].isEmpty())
+        {
+            return true;
+        }
     }
-    sendByteData(file_byte_data, true);
-    return true;
+    return false;
 }
 
 
 /**
- * @brief Установка интервала отправки пакетов
- * @param ms - временной интервал (в миллисекундах)
+ * @brief Выбор класса трафика, пакет которого будет отправлен следующим
+ * @return класс трафика, -1 - если очереди пусты
  *
+ * служебные пакеты (предложения файлов и ответы на них, квитанции
+ * отправляются вне очередей) имеют строгий приоритет; между текстом и файлами
+ * используется deficit round robin: при переходе очереди к классу его кредит
+ * увеличивается на вес * размер пакета, пакет отправляется, пока кредита
+ * хватает на его размер. Пустая очередь теряет накопленный кредит.
  */
-void UDPClient::setInterval(const uint &ms)
+int UDPClient::selectClass()
 {
-    interval = ms;
-    tmr->setInterval(interval);
+    if (!message_to_send[CONTROL].isEmpty())
+    {
+        return CONTROL;
+    }
+    if (message_to_send[INTERACTIVE].isEmpty() &&
+            message_to_send[BULK].isEmpty())
+    {
+        return -1;
+    }
+
+    qint64 quantum = datagram_size + Header::size;
+    while (true)
+    {
+        QQueue<QNetworkDatagram> &queue = message_to_send[drr_class];
+        qint64 head_size = queue.isEmpty() ? 0 : queue.head().data().size();
+        if (!queue.isEmpty() && deficit[drr_class] >= head_size)
+        {
+            deficit[drr_class] -= head_size;
+            return drr_class;
+        }
+        if (queue.isEmpty())
+        {
+            deficit[drr_class] = 0;
+        }
+        drr_class = (drr_class == INTERACTIVE) ? BULK : INTERACTIVE;
+        deficit[drr_class] += weight[drr_class] * quantum;
+    }
 }
 
 
 /**
- * @brief Получение минимального размера пакета, исходя из размера служебной
- * информации
- * @return минимальный размер пакета данных
+ * @brief Проверка, истек ли интервал с момента отправки последнего пакета
+ * @return true, если можно отправлять следующий пакет, иначе - false
  */
-uint UDPClient::getMinDatagramSize()
+bool UDPClient::isPacerReady() const
 {
-    return metadata_size + 1;
+    return !last_send.isValid() || last_send.elapsed() >= interval;
 }
 
 
 /**
- * @brief Слот срабатывает, если есть доступные для чтения пакеты
- *
- * принимаются пакеты, пока есть доступные,
- * из каждого извлекаестя порядковый номер и общее количество
- * далее пакеты помещаются в ассоциативный массив, ключом которого является
- * порядковый номер, а значением - содержимое пакета
- *
- * далее если дошли не все пакеты, то ждем, пока дойдут все,
- * если все пакеты дошли, то формируется сообщение из пакетов по порядку;
- * если пришел файл, то из сообщения извлекается название файла, а сам файл
- * записывается в рабочую директорию.
- * также отправляется информация о том, что сообщение было доставлено.
+ * @brief Планирование отправки пакетов из очереди
  *
+ * если интервал с прошлой отправки истек, пакет отправляется сразу,
+ * иначе таймер запускается на оставшееся время; при пустой очереди
+ * таймер не запускается.
  */
-void UDPClient::onReadyRead()
+void UDPClient::scheduleSend()
 {
-    IncomingDatagram datagram;
-    QByteArray message;
-    QNetworkDatagram n_datagram;
+    if (!hasPendingDatagrams() || tmr->isActive())
+    {
+        return;
+    }
 
-    while (_socket.hasPendingDatagrams())
+    if (isPacerReady())
     {
-        n_datagram = _socket.receiveDatagram(_socket.pendingDatagramSize());
-        datagram.processDatagram(n_datagram, byte_count_size, metadata_size);
+        sendDatagram();
+    }
+    else
+    {
+        startPacing(interval - last_send.elapsed());
+    }
+}
+
+
+/**
+ * @brief Отправка нескольких пакетов файла одним вызовом (GSO)
+ *
+ * из очереди файлов берутся подряд идущие пакеты одного получателя и одного
+ * размера (последний может быть меньше), не более gso_segments; кредит
+ * класса уменьшается на размер дополнительных пакетов. Если отправить
+ * одним вызовом не удалось, пакеты отправляются по одному; GSO отключается,
+ * только если он недоступен для сокета (ошибки, относящиеся к размеру
+ * сегмента, например EINVAL, и временные ошибки не отключают).
+ */
+void UDPClient::writeBulkSegments()
+{
+    QQueue<QNetworkDatagram> &queue = message_to_send[BULK];
+    QNetworkDatagram first = queue.dequeue();
+    QHostAddress address = first.destinationAddress();
+    quint16 port = first.destinationPort();
+    QVector<QByteArray> segments;
+    segments.append(first.data());
+    int segment_size = first.data().size();
+    int total_size = segment_size;
 
-        if (datagram.isDelivered())
+    while (!queue.isEmpty() && segments.size() < int(gso_segments) &&
+           segments.last().size() == segment_size)
+    {
+        const QNetworkDatagram &next = queue.head();
+        int size = next.data().size();
+        if (next.destinationAddress() != address ||
+                next.destinationPort() != port || size > segment_size ||
+                total_size + size > UdpOffload::max_buffer_size)
         {
-            emit messageDelivered(datagram.getSender());
-            return;
+            break;
         }
-
-        current_incoming_message.insert(datagram.getPosition(),
-                                        datagram.getData());
+        segments.append(queue.dequeue().data());
+        total_size += size;
+        deficit[BULK] -= size;
     }
 
-    if (current_incoming_message.size() != datagram.getTotalCount())
+    if (Tracer::isEnabled())
+    {
+        for (auto i = 0; i < segments.size(); i++)
+        {
+            TRACE_DATAGRAM_INSTANT("writeSegment", segments[i]);
+        }
+    }
+    TRACE_DATAGRAM_SCOPE("writeSegments", segments.first());
+    bool unsupported = false;
+    if (segments.size() > 1 &&
+            UdpOffload::writeSegments(_socket.socketDescriptor(), segments,
+                                      address, port, unsupported) >= 0)
     {
         return;
     }
 
-    for (auto i = 0; i < current_incoming_message.size(); i++)
+    if (unsupported)
     {
-        message.append(current_incoming_message[i]);
+        gso_segments = 1;
     }
-
-    if (!datagram.isFile())
+    for (auto i = 0; i < segments.size(); i++)
     {
-        emit newMessage(datagram.getSender(), QString(message));
+        _socket.writeDatagram(segments[i], address, port);
     }
-    else
+}
+
+
+/**
+ * @brief Запуск таймера отправки
+ * @param ms - время до отправки следующего пакета (в миллисекундах)
+ */
+void UDPClient::startPacing(const qint64 &ms)
+{
+    if (Tracer::isEnabled())
     {
-        emit newMessage(datagram.getSender(), processIncomingFile(message));
+        pacing_start = Tracer::now();
     }
+    tmr->start(ms);
+}
 
-    current_incoming_message.clear();
-    _socket.writeDatagram(formDeliveredAnswer(datagram.getTotalCount()),
-                          datagram.getSender().getAddress(),
-                          datagram.getSender().getPort());
+
+/**
+ * @brief Формирование пакета из нескольких коротких сообщений
+ * @param messages - сообщения
+ * @return пакет: флаг '2', общее количество пакетов = 1, номер пакета = 0,
+ * далее для каждого сообщения - его длина и содержимое
+ */
+QByteArray UDPClient::formBatchDatagram(const QVector<QByteArray> &messages)
+{
+    QByteArray payload;
+    for (auto i = 0; i < messages.size(); i++)
+    {
+        QByteArray length(Header::count_digits, Qt::Uninitialized);
+        Header::storeCount(length.data(), messages[i].size());
+        payload.append(length);
+        payload.append(messages[i]);
+    }
+    return formServiceDatagram(Header::flags::batch, payload);
 }
 
 
 /**
- * @brief Преобразование числа в массив 4х байт
- * @param number - исходное число
- * @return 4х байтный массив с числом
+ * @brief Формирование служебного пакета из одной части
+ * @param flag - вид пакета: '2' - несколько коротких сообщений,
+ * '4' - ответ на предложение файла
+ * @param payload - содержимое пакета
+ * @return пакет: флаг, общее количество пакетов = 1, номер пакета = 0,
+ * содержимое
  */
-QByteArray UDPClient::numberToByte(const count_size &number,
-                                   const uint &count_b)
+QByteArray UDPClient::formServiceDatagram(char flag, const QByteArray &payload)
 {
-    QByteArray result, tmp;
-    result.resize(count_b);
-    result.fill('0');
-    tmp.setNum(number, 16);
-    result.replace(count_b - tmp.size(), tmp.size(), tmp);
-    return result;
+    QByteArray datagram = Header::encode(flag, 1, 0);
+    datagram.append(payload);
+    return datagram;
 }
 
 
 /**
- * @brief Формирование пакета в случае успешной доставки сообщения
- * @param count - кодичество пакетов доставленного сообщения
- * @return "служебный пакет" -
- * первые 4 байта равны вторым 4м = количеству пакетов
+ * @brief Отправка накопленных коротких сообщений
+ *
+ * одно сообщение отправляется обычным образом, несколько - одним пакетом
  */
-QByteArray UDPClient::formDeliveredAnswer(const count_size &count)
+void UDPClient::flushSmallMessages()
 {
-    QByteArray answer;
-    answer.append('0');
-    answer.append(numberToByte(count, byte_count_size));
-    answer.append(numberToByte(count, byte_count_size));
-    answer.append("/0");
-    return answer;
+    linger_tmr->stop();
+    if (pending_small.isEmpty())
+    {
+        return;
+    }
+
+    if (pending_small.size() == 1)
+    {
+        sendByteData(pending_small.first());
+    }
+    else
+    {
+        enqueueDatagram(INTERACTIVE, formBatchDatagram(pending_small),
+                        receiver);
+    }
+    pending_small.clear();
+    pending_size = 0;
+    scheduleSend();
 }
 
 
 /**
- * @brief Передача бинарных данных
- * @param ba_message - данные (массив байт)
- * @param is_file - флаг: true - передаваемые данные файл,
- * иначе - обычное текстовое сообщение
+ * @brief Параллельная передача файла по полосам
+ * @param data - данные файла (вместе с названием)
+ *
+ * пакеты файла делятся на stripe_count непрерывных полос, каждая полоса
+ * формируется и отправляется своим потоком через свой сокет на
+ * соответствующий порт получателя; порядковые номера пакетов сквозные,
+ * поэтому получатель собирает файл из всех полос в одну сборку. Данные
+ * файла не копируются (QByteArray с общими данными только читается).
  *
- * исходные данные разделяются на пакеты размером datagram_size, сначала к
- * каждому пакету добавляется флаг файла; далее к каждому пакету в начало
- * добавляется порядковый номер пакета, потом еще общее
- * количество пакетов, на которое разделилось исходное сообщение
+ * получатель собирает один файл от отправителя за раз, поэтому следующий
+ * файл ждет в очереди, пока не отправлены все полосы текущего (иначе полоса,
+ * закончившаяся раньше, начала бы следующий файл, и пакеты двух файлов
+ * смешались бы в одной сборке).
  */
-void UDPClient::sendByteData(const QByteArray &ba_message, bool is_file)
+void UDPClient::sendStriped(const QByteArray &data)
+{
+    if (stripes_in_flight > 0)
+    {
+        striped_files.enqueue(data);
+        return;
+    }
+    startStriped(data);
+}
+
+
+/**
+ * @brief Запуск передачи файла по полосам
+ * @param data - данные файла (вместе с названием)
+ */
+void UDPClient::startStriped(const QByteArray &data)
 {
-    lates_message.clear();
-    count_size ba_size = ba_message.size();
-    QByteArray position, total_count;
-    count_size count = 0;
-    char file_flag = '0';
+    count_size count = OutgoingMessage::countDatagrams(data.size(),
+                                                       datagram_size);
+    count_size per_stripe = (count + stripe_senders.size() - 1) /
+            stripe_senders.size();
+    Client stripe_receiver = receiver;
+    uint size = datagram_size;
+    uint ms = interval;
+    uint segments = gso_segments;
 
-    if (is_file)
+    for (int i = 0; i < stripe_senders.size(); i++)
     {
-        file_flag = '1';
+        count_size first = i * per_stripe;
+        if (first >= count)
+        {
+            break;
+        }
+        StripeSender *sender = stripe_senders[i];
+        stripes_in_flight++;
+        QMetaObject::invokeMethod(sender, [sender, data, size, first,
+                                  per_stripe, stripe_receiver, ms,
+                                  segments]()
+        {
+            sender->sendStripe(data, Header::flags::file, size, first,
+                               per_stripe, stripe_receiver, ms, segments);
+        }, Qt::QueuedConnection);
     }
+}
 
-    for (count_size pos = 0; pos < ba_size; pos += datagram_size, count++)
+
+/**
+ * @brief Завершение потоков отправителей полос
+ */
+void UDPClient::stopStripes()
+{
+    for (auto i = 0; i < stripe_threads.size(); i++)
     {
-        QByteArray datagram = ba_message.mid(pos, datagram_size);
-        position = numberToByte(count, byte_count_size);
-        datagram.prepend(position);
-        lates_message.append(datagram);
+        stripe_threads[i]->quit();
+        stripe_threads[i]->wait();
+        delete stripe_threads[i];
     }
+    stripe_threads.clear();
+    stripe_senders.clear();
+    stripes_bound = false;
+    stripes_in_flight = 0;
+    striped_files.clear();
+}
 
-    total_count = numberToByte(count, byte_count_size);
 
-    for (auto i = 0; i < lates_message.size(); i++)
+/**
+ * @brief Слот срабатывает, если в потоке полосы начата частичная сборка
+ * сообщения
+ *
+ * таймер проверки устаревших сообщений работает, только пока есть частично
+ * собранные сообщения (останавливается в evictExpiredMessages).
+ */
+void UDPClient::onStripePartial()
+{
+    if (!reassembly.isEmpty() && !reassembly_tmr->isActive())
+    {
+        reassembly_tmr->start();
+    }
+}
+
+
+/**
+ * @brief Слот срабатывает, если поток полосы отправил свою полосу
+ *
+ * когда отправлены все полосы текущего файла, начинается передача
+ * следующего файла из очереди. Сигналы потоков, завершенных при изменении
+ * количества полос, не учитываются.
+ */
+void UDPClient::onStripeSent()
+{
+    StripeSender *stripe = static_cast<StripeSender *>(sender());
+    if (!stripe_senders.contains(stripe) || stripes_in_flight == 0)
+    {
+        return;
+    }
+    stripes_in_flight--;
+    if (stripes_in_flight == 0 && !striped_files.isEmpty())
     {
-        lates_message[i].prepend(total_count);
-        lates_message[i].prepend(file_flag);
-        message_to_send.append(lates_message[i]);
+        startStriped(striped_files.dequeue());
     }
 }
 
 
+/**
+ * @brief Слот срабатывает, если сокет полосы принял пакет, который не
+ * собирается в потоке полосы (квитанция, служебный пакет, пересылка)
+ * @param n_datagram - пакет (порт отправителя - порт его основного сокета)
+ * @param received_ns - время приема пакета в потоке полосы
+ */
+void UDPClient::onStripeDatagram(const QNetworkDatagram &n_datagram,
+                                 const qint64 &received_ns)
+{
+    processIncomingDatagram(n_datagram, received_ns);
+}
+
+
+/**
+ * @brief Слот срабатывает, если сообщение собрано в потоке полосы
+ * @param n_datagram - последний пакет сообщения
+ * @param message - сообщение целиком
+ */
+void UDPClient::onStripeMessage(const QNetworkDatagram &n_datagram,
+                                const QByteArray &message)
+{
+    IncomingDatagram datagram;
+    datagram.processDatagram(n_datagram);
+    processMessage(datagram, message);
+}
+
+
 /**
  * @brief Представление файла как последовательности байт
  * @param file_name - название файла (полный путь)
@@ -308,6 +1426,24 @@ QByteArray UDPClient::formFileByteData(const QString &file_name)
 }
 
 
+/**
+ * @brief Обработка входящего текстового сообщения
+ * @param message - байты сообщения (UTF-8)
+ * @return текст сообщения либо сообщение об ошибке, если данные не
+ * являются корректным UTF-8
+ */
+QString UDPClient::processIncomingText(const QByteArray &message)
+{
+    TRACE_SCOPE("processIncomingText", message.size(), 0);
+    QString text;
+    if (!Utf8Decoder::decode(message, text))
+    {
+        return "Получено некорректное сообщение";
+    }
+    return text;
+}
+
+
 /**
  * @brief Обработка входящего файла
  * @param datagram - последовательность байт, содержащая файл
@@ -320,6 +1456,7 @@ QByteArray UDPClient::formFileByteData(const QString &file_name)
  */
 QString UDPClient::processIncomingFile(const QByteArray &datagram)
 {
+    TRACE_SCOPE("processIncomingFile", datagram.size(), 0);
     QString result_message;
 
     QByteArray file_name_b, result_data;
@@ -328,11 +1465,15 @@ QString UDPClient::processIncomingFile(const QByteArray &datagram)
     {
         file_name_b.append(datagram[i]);
     }
-    file_name = QString(file_name_b);
+    file_name = receivedFileName(file_name_b);
+    if (file_name.isEmpty())
+    {
+        return "Получено некорректное название файла";
+    }
     result_data = datagram.mid(file_name_size);
     QFile new_file(file_name);
     int result = 0;
-    if (new_file.open(QIODevice::ReadWrite))
+    if (new_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
     {
         result = new_file.write(result_data);
         if (result != result_data.size())
@@ -344,6 +1485,10 @@ QString UDPClient::processIncomingFile(const QByteArray &datagram)
             result_message = "Вы получили файл: " + file_name;
         }
         new_file.close();
+        if (dedup && result == result_data.size())
+        {
+            store.add(result_data);
+        }
     }
     else
     {
@@ -353,19 +1498,69 @@ QString UDPClient::processIncomingFile(const QByteArray &datagram)
 }
 
 
+/**
+ * @brief Название полученного файла
+ * @param name_b - название из сообщения (UTF-8, до первого нулевого байта)
+ * @return название файла без пути, пустая строка - если название
+ * некорректное
+ *
+ * файл создается только в рабочей директории: пути (абсолютные и с "..")
+ * отвергаются, от остальных названий остается только имя файла.
+ */
+QString UDPClient::receivedFileName(const QByteArray &name_b)
+{
+    int end = name_b.indexOf('\0');
+    QString name = QString::fromUtf8(end < 0 ? name_b : name_b.left(end));
+    name.replace('\\', '/');
+    if (name.isEmpty() || QDir::isAbsolutePath(name) ||
+            name.split('/').contains(".."))
+    {
+        return QString();
+    }
+
+    name = QFileInfo(name).fileName();
+    if (name.isEmpty() || name == ".")
+    {
+        return QString();
+    }
+    return name;
+}
+
+
 /**
  * @brief Отправляет пакет по истечению интервала
  *
+ * пакет выбирается из очередей классов трафика (см. selectClass);
+ * если в очередях остались пакеты, таймер запускается на следующий интервал
  */
 void UDPClient::sendDatagram()
 {
-    if (message_to_send.isEmpty())
+    if (pacing_start >= 0)
+    {
+        Tracer::complete("pacingWait", pacing_start, 0, 0);
+        pacing_start = -1;
+    }
+
+    int traffic_class = selectClass();
+    if (traffic_class < 0)
     {
         return;
     }
 
-    _socket.writeDatagram(message_to_send.last(),
-                          receiver.getAddress(),
-                          receiver.getPort());
-    message_to_send.removeLast();
+    if (traffic_class == BULK && gso_segments > 1)
+    {
+        writeBulkSegments();
+    }
+    else
+    {
+        TRACE_DATAGRAM_SCOPE("writeDatagram",
+                             message_to_send[traffic_class].head().data());
+        _socket.writeDatagram(message_to_send[traffic_class].dequeue());
+    }
+    last_send.start();
+
+    if (hasPendingDatagrams())
+    {
+        startPacing(interval);
+    }
 }
@@ -6,12 +6,42 @@
 #include <QHostAddress>
 #include <QNetworkDatagram>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QDeadlineTimer>
 #include <QFile>
+#include <QFileInfo>
+#include <QDir>
 #include <QDataStream>
+#include <QQueue>
+#include <QSet>
+#include <QSocketNotifier>
+#include <QThread>
 
 #include "client.h"
 #include "mytypes.h"
 #include "incomingdatagram.h"
+#include "headercodec.h"
+#include "stripesender.h"
+#include "outgoingmessage.h"
+#include "tracer.h"
+#include "udpoffload.h"
+#include "reassemblymanager.h"
+#include "contentstore.h"
+#include "utf8decoder.h"
+
+
+/**
+ * @brief Статистика пересылки пакетов
+ */
+struct RelayStats
+{
+    // пересланные пакеты
+    quint64 forwarded;
+
+    // суммарное и наибольшее время от приема пакета до его пересылки (нс)
+    qint64 latency_total_ns;
+    qint64 latency_max_ns;
+};
 
 
 /**
@@ -33,20 +63,52 @@ public:
 
     bool bindLocal(const QString &ip_addr, const quint16 &port);
     bool connectTo(const QString &ip_addr, const quint16 &port);
-    void sendMessage(const QString &message);
+    bool sendMessage(const QString &message);
     bool sendFile(const QString &file_name);
 
     void setInterval(const uint &ms);
     uint getMinDatagramSize(void);
 
+    void setStripeCount(const uint &count);
+
+    void setLinger(const uint &ms);
+
+    void setWeights(const uint &interactive, const uint &bulk);
+
+    void setOffload(const uint &segments);
+
+    void setReassemblyLimits(const qint64 &budget, const qint64 &quota,
+                             const qint64 &timeout_ms);
+    ReassemblyStats getReassemblyStats(void) const;
+
+    void addRoute(const Client &source, const Client &destination);
+    void removeRoute(const Client &source);
+    RelayStats getRelayStats(void) const;
+
+    void setDedup(const bool &on);
+    void setStoreDirectory(const QString &dir);
+
 
 signals:
     void newMessage(const Client &sender, const QString &message);
+
+    // получатель подтвердил доставку: сообщения, файла или пакета с
+    // несколькими короткими сообщениями (при объединении, см. setLinger, -
+    // одно подтверждение на все сообщения пакета)
     void messageDelivered(const Client &sender);
 
 private slots:
     void onReadyRead();
+    void onOffloadReadyRead();
     void sendDatagram();
+    void onStripeDatagram(const QNetworkDatagram &n_datagram,
+                          const qint64 &received_ns);
+    void onStripeMessage(const QNetworkDatagram &n_datagram,
+                         const QByteArray &message);
+    void onStripeSent();
+    void onStripePartial();
+    void flushSmallMessages();
+    void evictExpiredMessages();
 
 private:
 
@@ -59,15 +121,6 @@ private:
     // интервал отправки пакета
     uint interval;
 
-    // размер служебной информации в пакете, например, - 9 байт:
-    // первый - флаг, является ли передаваемое сообщение файлом,
-    // следующие 4 - общее количество пакетов сообщения,
-    // следующие 4 - порядковый номер пакета
-    uint metadata_size;
-
-    // размер числа, хранящего количество пакетов, соответствует count_size
-    uint byte_count_size;
-
     // максимально допустимый размер названия файла (байты)
     uint file_name_size;
 
@@ -75,28 +128,190 @@ private:
     Client receiver;
 
     // таймер, для задания частоты отправки пакетов
+    // (запускается, только пока очередь отправки не пуста)
     QTimer *tmr;
 
+    // время с момента отправки последнего пакета
+    QElapsedTimer last_send;
+
+    // время запуска таймера отправки (для трассировки), -1 - не запущен
+    qint64 pacing_start;
+
+    // время ожидания (мс) для объединения коротких сообщений в один пакет,
+    // 0 - не объединять (по умолчанию: клиенты без поддержки объединения
+    // показывают такой пакет как текст)
+    uint linger;
+
+    // таймер ожидания для объединения коротких сообщений
+    QTimer *linger_tmr;
+
+    // короткие сообщения, ожидающие объединения в один пакет
+    QVector<QByteArray> pending_small;
+
+    // размер объединенного пакета без служебной информации
+    uint pending_size;
+
     // текущее отправляемое сообщение
     QVector<QByteArray> lates_message;
 
-    // содержит пакеты, которые необходимо отправить
-    QVector<QByteArray> message_to_send;
+    // классы трафика: служебные пакеты (предложения файлов и ответы на них)
+    // отправляются в первую очередь, между текстом и файлами пакеты
+    // распределяются по весам; квитанции отправляются сразу, вне очередей
+    enum TrafficClass
+    {
+        CONTROL,
+        INTERACTIVE,
+        BULK,
+        CLASS_COUNT
+    };
+
+    // содержит пакеты, которые необходимо отправить, отдельно по классам
+    QQueue<QNetworkDatagram> message_to_send[CLASS_COUNT];
+
+    // веса классов INTERACTIVE и BULK (в квантах размера пакета)
+    uint weight[CLASS_COUNT];
+
+    // накопленный кредит класса (байты), deficit round robin
+    qint64 deficit[CLASS_COUNT];
+
+    // класс, чья очередь обслуживается сейчас (INTERACTIVE или BULK)
+    int drr_class;
+
+    // таблица пересылки: ключ - адрес отправителя (formPrettyAddress),
+    // значение - куда пересылать его пакеты; порт 0 - любой порт
+    QHash<QString, Client> routes;
+
+    // статистика пересылки
+    RelayStats relay_stats;
+
+    // предлагать ли получателю файл по хэшу перед передачей (выключено по
+    // умолчанию: клиенты без поддержки предложений показывают его как текст)
+    bool dedup;
+
+    // время ожидания ответа на предложение файла (мс), после него файл
+    // передается полностью
+    uint offer_timeout;
+
+    // предложенные файлы, ожидающие ответа: ключ - хэш содержимого,
+    // значение - данные файла вместе с названием
+    QHash<QByteArray, QByteArray> offered_files;
+
+    // получатели предложенных файлов: ключ - хэш содержимого, значение -
+    // адрес получателя (formPrettyAddress)
+    QHash<QByteArray, QString> offer_peers;
+
+    // получатели, не ответившие на предложение (не поддерживают
+    // предложения), им файлы передаются сразу
+    QSet<QString> legacy_peers;
+
+    // хранилище полученных файлов
+    ContentStore store;
+
+    // частично собранные входящие сообщения
+    ReassemblyManager reassembly;
 
-    // текущее входящее сообщение
-    QHash<count_size, QByteArray> current_incoming_message;
+    // таймер проверки устаревших входящих сообщений
+    // (запускается, только пока есть частично собранные сообщения)
+    QTimer *reassembly_tmr;
 
+    // максимальное количество пакетов файла, отправляемых одним вызовом
+    // (GSO, только Linux), 1 - отправлять по одному
+    uint gso_segments;
+
+    // дескриптор сокета для приема с объединением пакетов (GRO), -1 - нет
+    qintptr gro_fd;
+
+    // уведомитель о входящих данных при приеме с объединением пакетов
+    QSocketNotifier *gro_notifier;
+
+    // количество полос (потоков), на которые разделяется отправляемый файл
+    uint stripe_count;
+
+    // потоки отправителей полос
+    QVector<QThread *> stripe_threads;
+
+    // отправители полос, каждый живет в своем потоке
+    QVector<StripeSender *> stripe_senders;
+
+    // привязаны ли сокеты всех полос (иначе файлы передаются без полос)
+    bool stripes_bound;
+
+    // количество полос текущего файла, которые еще отправляются
+    int stripes_in_flight;
+
+    // файлы, ожидающие передачи по полосам (данные вместе с названием)
+    QQueue<QByteArray> striped_files;
 
-    QByteArray numberToByte(const count_size &number, const uint &count_b);
 
     QByteArray formDeliveredAnswer(const count_size &count);
 
+    QVector<QByteArray> formDatagrams(const QByteArray &ba_message,
+                                      bool is_file);
+
     void sendByteData(const QByteArray &data, bool is_file = false);
 
+    void sendStriped(const QByteArray &data);
+
+    void startStriped(const QByteArray &data);
+
+    bool isPacerReady(void) const;
+
+    void startPacing(const qint64 &ms);
+
+    bool hasPendingDatagrams(void) const;
+
+    void enqueueDatagram(const int &traffic_class, const QByteArray &data,
+                         const Client &destination);
+
+    int selectClass(void);
+
+    void sendDeliveredAnswer(const Client &sender, const count_size &count);
+
+    void scheduleSend(void);
+
+    QByteArray formServiceDatagram(char flag, const QByteArray &payload);
+
+    QByteArray formBatchDatagram(const QVector<QByteArray> &messages);
+
+    void sendFileData(const QByteArray &file_byte_data);
+
+    void sendOfferedFile(const QByteArray &file_digest);
+
+    void processOffer(const IncomingDatagram &datagram);
+
+    void processOfferReply(const IncomingDatagram &datagram);
+
+    void offerTimedOut(const QByteArray &file_digest);
+
+    void processBatch(const IncomingDatagram &datagram);
+
+    void processIncomingDatagram(const QNetworkDatagram &n_datagram,
+                                 const qint64 &received_ns);
+
+    void processMessage(const IncomingDatagram &datagram,
+                        const QByteArray &message);
+
+    bool relayDatagram(const QNetworkDatagram &n_datagram,
+                       const qint64 &received_ns);
+
+    void enableOffload(void);
+
+    void enableGroReceive(void);
+
+    void writeBulkSegments(void);
+
+    void stopStripes(void);
+
+    bool bindStripes(void);
+
     QByteArray formFileByteData(const QString &file_name);
 
     QString processIncomingFile(const QByteArray &datagram);
 
+    static QString receivedFileName(const QByteArray &name_b);
+
+    QString processIncomingText(const QByteArray &message);
+
 };
 
 #endif // UDPCLIENT_H
@@ -0,0 +1,274 @@
+#include "udpoffload.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+// значения из linux/udp.h, если их нет в заголовках libc
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+
+/**
+ * @brief Включение объединения входящих пакетов (GRO) на сокете
+ * @param fd - дескриптор привязанного udp сокета
+ * @return true, если ядро поддерживает UDP_GRO, иначе - false
+ */
+bool UdpOffload::enableGro(const qintptr &fd)
+{
+#ifdef Q_OS_LINUX
+    int on = 1;
+    return setsockopt(fd, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+#else
+    Q_UNUSED(fd);
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Проверка поддержки сегментации при отправке (GSO)
+ * @param fd - дескриптор udp сокета
+ * @return true, если ядро поддерживает UDP_SEGMENT, иначе - false
+ *
+ * проверяется один раз для сокета: ошибки отдельных вызовов writeSegments
+ * (например, EINVAL при сегменте больше MTU пути) не означают, что GSO не
+ * поддерживается.
+ */
+bool UdpOffload::supportsGso(const qintptr &fd)
+{
+#ifdef Q_OS_LINUX
+    int segment_size = 0;
+    socklen_t size = sizeof(segment_size);
+    return getsockopt(fd, IPPROTO_UDP, UDP_SEGMENT, &segment_size,
+                      &size) == 0;
+#else
+    Q_UNUSED(fd);
+    return false;
+#endif
+}
+
+
+/**
+ * @brief Дублирование дескриптора сокета
+ * @param fd - дескриптор
+ * @return новый дескриптор того же сокета, -1 - в случае ошибки
+ *
+ * используется, чтобы следить за чтением сокета отдельным QSocketNotifier,
+ * не конфликтуя с уведомителем самого QUdpSocket.
+ */
+qintptr UdpOffload::duplicate(const qintptr &fd)
+{
+#ifdef Q_OS_LINUX
+    return dup(fd);
+#else
+    Q_UNUSED(fd);
+    return -1;
+#endif
+}
+
+
+/**
+ * @brief Закрытие дескриптора, полученного через duplicate
+ * @param fd - дескриптор
+ */
+void UdpOffload::release(const qintptr &fd)
+{
+#ifdef Q_OS_LINUX
+    close(fd);
+#else
+    Q_UNUSED(fd);
+#endif
+}
+
+
+/**
+ * @brief Отправка нескольких пакетов одним вызовом (GSO)
+ * @param fd - дескриптор udp сокета
+ * @param segments - пакеты; все, кроме последнего, одного размера
+ * @param address - адрес получателя
+ * @param port - порт получателя
+ * @param unsupported - сюда записывается true, если ошибка означает, что
+ * GSO недоступен для этого сокета (EOPNOTSUPP, EIO - устройство не
+ * вычисляет контрольные суммы, или не Linux), false - если ошибка относится
+ * только к этому вызову (например, EINVAL - сегмент больше MTU пути,
+ * EAGAIN, ENOBUFS) или ее нет
+ * @return количество отправленных байт, -1 - если произошла ошибка (пакеты
+ * не отправлены)
+ */
+qint64 UdpOffload::writeSegments(const qintptr &fd,
+                                 const QVector<QByteArray> &segments,
+                                 const QHostAddress &address,
+                                 const quint16 &port,
+                                 bool &unsupported)
+{
+    unsupported = false;
+#ifdef Q_OS_LINUX
+    if (segments.isEmpty() || segments.size() > max_segments)
+    {
+        return -1;
+    }
+
+    // семейство адресов самого сокета: ipv4 получатель для ipv6 сокета
+    // задается как ipv4-mapped адрес
+    sockaddr_storage local;
+    socklen_t local_size = sizeof(local);
+    if (getsockname(fd, reinterpret_cast<sockaddr *>(&local), &local_size))
+    {
+        return -1;
+    }
+
+    sockaddr_storage to;
+    socklen_t to_size;
+    memset(&to, 0, sizeof(to));
+    if (local.ss_family == AF_INET)
+    {
+        sockaddr_in *to4 = reinterpret_cast<sockaddr_in *>(&to);
+        to4->sin_family = AF_INET;
+        to4->sin_port = htons(port);
+        to4->sin_addr.s_addr = htonl(address.toIPv4Address());
+        to_size = sizeof(sockaddr_in);
+    }
+    else
+    {
+        sockaddr_in6 *to6 = reinterpret_cast<sockaddr_in6 *>(&to);
+        QHostAddress address6 = address;
+        if (address.protocol() == QAbstractSocket::IPv4Protocol)
+        {
+            address6 = QHostAddress("::ffff:" + address.toString());
+        }
+        Q_IPV6ADDR ip6 = address6.toIPv6Address();
+        to6->sin6_family = AF_INET6;
+        to6->sin6_port = htons(port);
+        memcpy(&to6->sin6_addr, &ip6, sizeof(ip6));
+        to_size = sizeof(sockaddr_in6);
+    }
+
+    iovec iov[max_segments];
+    for (auto i = 0; i < segments.size(); i++)
+    {
+        iov[i].iov_base = const_cast<char *>(segments[i].constData());
+        iov[i].iov_len = segments[i].size();
+    }
+
+    char control[CMSG_SPACE(sizeof(quint16))];
+    memset(control, 0, sizeof(control));
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &to;
+    msg.msg_namelen = to_size;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = segments.size();
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    quint16 segment_size = segments.first().size();
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(segment_size));
+    memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+
+    qint64 result = sendmsg(fd, &msg, 0);
+    if (result < 0)
+    {
+        unsupported = (errno == EOPNOTSUPP || errno == EIO);
+    }
+    return result;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(segments);
+    Q_UNUSED(address);
+    Q_UNUSED(port);
+    unsupported = true;
+    return -1;
+#endif
+}
+
+
+/**
+ * @brief Прием доступных пакетов с разделением объединенных буферов (GRO)
+ * @param fd - дескриптор udp сокета (неблокирующий)
+ * @param datagrams - сюда добавляются принятые пакеты
+ * @return количество принятых пакетов
+ *
+ * за один вызов читается не более max_segments буферов, чтобы не задерживать
+ * цикл обработки событий. Обрезанные буферы (MSG_TRUNC) отбрасываются
+ * целиком - последний пакет в них был бы неполным.
+ */
+int UdpOffload::readSegments(const qintptr &fd,
+                             QVector<QNetworkDatagram> &datagrams)
+{
+    int count = 0;
+#ifdef Q_OS_LINUX
+    QByteArray buffer(max_receive_size, Qt::Uninitialized);
+
+    for (auto i = 0; i < max_segments; i++)
+    {
+        sockaddr_storage from;
+        iovec iov;
+        iov.iov_base = buffer.data();
+        iov.iov_len = buffer.size();
+
+        char control[CMSG_SPACE(sizeof(int))];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &from;
+        msg.msg_namelen = sizeof(from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t size = recvmsg(fd, &msg, MSG_DONTWAIT);
+        if (size < 0)
+        {
+            break;
+        }
+        if (msg.msg_flags & MSG_TRUNC)
+        {
+            continue;
+        }
+
+        int segment_size = size;
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+             cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+            {
+                memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+            }
+        }
+        if (segment_size <= 0)
+        {
+            segment_size = size;
+        }
+
+        QHostAddress sender(reinterpret_cast<sockaddr *>(&from));
+        quint16 sender_port = (from.ss_family == AF_INET6) ?
+                    ntohs(reinterpret_cast<sockaddr_in6 *>(&from)->sin6_port) :
+                    ntohs(reinterpret_cast<sockaddr_in *>(&from)->sin_port);
+
+        for (ssize_t pos = 0; pos < size; pos += segment_size)
+        {
+            QNetworkDatagram datagram(buffer.mid(pos, segment_size));
+            datagram.setSender(sender, sender_port);
+            datagrams.append(datagram);
+            count++;
+        }
+    }
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(datagrams);
+#endif
+    return count;
+}
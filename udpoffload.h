@@ -0,0 +1,52 @@
+#ifndef UDPOFFLOAD_H
+#define UDPOFFLOAD_H
+
+#include <QByteArray>
+#include <QVector>
+#include <QHostAddress>
+#include <QNetworkDatagram>
+
+
+/**
+ * @brief Аппаратная/программная сегментация udp пакетов (Linux)
+ *
+ * GSO (UDP_SEGMENT): несколько пакетов одинакового размера (последний может
+ * быть меньше) передаются ядру одним системным вызовом и нарезаются им на
+ * отдельные пакеты;
+ * GRO (UDP_GRO): ядро объединяет подряд идущие пакеты одного потока в один
+ * буфер и сообщает размер сегмента, буфер снова делится на пакеты.
+ *
+ * на других платформах и старых ядрах функции возвращают ошибку, и
+ * вызывающий код переходит к обычной отправке/приему.
+ */
+class UdpOffload
+{
+public:
+    // максимальное количество сегментов в одном вызове (ограничение ядра)
+    static const int max_segments = 64;
+
+    // максимальный суммарный размер сегментов в одном вызове
+    static const int max_buffer_size = 65507;
+
+    // размер буфера приема (объединенный буфер ipv6 может быть больше
+    // max_buffer_size)
+    static const int max_receive_size = 65535;
+
+    static bool enableGro(const qintptr &fd);
+
+    static bool supportsGso(const qintptr &fd);
+
+    static qintptr duplicate(const qintptr &fd);
+    static void release(const qintptr &fd);
+
+    static qint64 writeSegments(const qintptr &fd,
+                                const QVector<QByteArray> &segments,
+                                const QHostAddress &address,
+                                const quint16 &port,
+                                bool &unsupported);
+
+    static int readSegments(const qintptr &fd,
+                            QVector<QNetworkDatagram> &datagrams);
+};
+
+#endif // UDPOFFLOAD_H
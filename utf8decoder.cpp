@@ -0,0 +1,245 @@
+#include "utf8decoder.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UTF8_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define UTF8_NEON
+#endif
+
+#include <QtGlobal>
+
+
+namespace
+{
+
+// размер блока векторной проверки ascii (байты), 0 - проверки нет
+#if defined(__AVX2__)
+const int vector_block = 32;
+#elif defined(UTF8_SSE2) || defined(UTF8_NEON)
+const int vector_block = 16;
+#else
+const int vector_block = 0;
+#endif
+
+
+/**
+ * @brief Векторное копирование ascii символов
+ * @param in - входные байты
+ * @param size - количество входных байт
+ * @param out - выходной буфер UTF-16
+ * @return количество скопированных байт (до первого не ascii блока)
+ */
+int copyAscii(const uchar *in, int size, ushort *out)
+{
+    int pos = 0;
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    for (; pos + 32 <= size; pos += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(in + pos));
+        if (_mm256_movemask_epi8(chunk) != 0)
+        {
+            break;
+        }
+        // распаковка работает внутри 128-битных половин, поэтому
+        // сначала переставляем 64-битные части
+        chunk = _mm256_permute4x64_epi64(chunk, 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + pos),
+                            _mm256_unpacklo_epi8(chunk, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + pos + 16),
+                            _mm256_unpackhi_epi8(chunk, zero));
+    }
+#elif defined(UTF8_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; pos + 16 <= size; pos += 16)
+    {
+        __m128i chunk = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(in + pos));
+        if (_mm_movemask_epi8(chunk) != 0)
+        {
+            break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + pos),
+                         _mm_unpacklo_epi8(chunk, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + pos + 8),
+                         _mm_unpackhi_epi8(chunk, zero));
+    }
+#elif defined(UTF8_NEON)
+    for (; pos + 16 <= size; pos += 16)
+    {
+        uint8x16_t chunk = vld1q_u8(in + pos);
+        if (vmaxvq_u8(chunk) >= 0x80)
+        {
+            break;
+        }
+        vst1q_u16(out + pos, vmovl_u8(vget_low_u8(chunk)));
+        vst1q_u16(out + pos + 8, vmovl_u8(vget_high_u8(chunk)));
+    }
+#else
+    Q_UNUSED(in);
+    Q_UNUSED(size);
+    Q_UNUSED(out);
+#endif
+    return pos;
+}
+
+
+inline bool isContinuation(const uchar &byte)
+{
+    return (byte & 0xC0) == 0x80;
+}
+
+
+/**
+ * @brief Преобразование одной многобайтовой последовательности UTF-8
+ * @param in - первый байт последовательности (не ascii)
+ * @param remaining - количество входных байт, начиная с in
+ * @param out - выходной буфер UTF-16
+ * @param written - количество записанных элементов (увеличивается на 1 или 2)
+ * @return длина последовательности (байты), -1 - некорректный UTF-8
+ */
+inline int decodeSequence(const uchar *in, int remaining, ushort *out,
+                          int &written)
+{
+    uchar lead = in[0];
+    uint code;
+    int length;
+
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        if (remaining < 2 || !isContinuation(in[1]))
+        {
+            return -1;
+        }
+        code = ((lead & 0x1F) << 6) | (in[1] & 0x3F);
+        length = 2;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        if (remaining < 3 || !isContinuation(in[1]) ||
+                !isContinuation(in[2]))
+        {
+            return -1;
+        }
+        // E0: избыточная запись, ED: суррогаты
+        if ((lead == 0xE0 && in[1] < 0xA0) || (lead == 0xED && in[1] > 0x9F))
+        {
+            return -1;
+        }
+        code = ((lead & 0x0F) << 12) | ((in[1] & 0x3F) << 6) | (in[2] & 0x3F);
+        length = 3;
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        if (remaining < 4 || !isContinuation(in[1]) ||
+                !isContinuation(in[2]) || !isContinuation(in[3]))
+        {
+            return -1;
+        }
+        // F0: избыточная запись, F4: больше U+10FFFF
+        if ((lead == 0xF0 && in[1] < 0x90) || (lead == 0xF4 && in[1] > 0x8F))
+        {
+            return -1;
+        }
+        code = ((lead & 0x07) << 18) | ((in[1] & 0x3F) << 12) |
+                ((in[2] & 0x3F) << 6) | (in[3] & 0x3F);
+        length = 4;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (code >= 0x10000)
+    {
+        code -= 0x10000;
+        out[written++] = ushort(0xD800 + (code >> 10));
+        out[written++] = ushort(0xDC00 + (code & 0x3FF));
+    }
+    else
+    {
+        out[written++] = ushort(code);
+    }
+    return length;
+}
+
+
+/**
+ * @brief Проверка и преобразование UTF-8 в UTF-16
+ * @param in - входные байты
+ * @param size - количество входных байт
+ * @param out - выходной буфер (не меньше size элементов)
+ * @return количество записанных элементов UTF-16, -1 - некорректный UTF-8
+ *
+ * блок, в котором векторная проверка нашла не ascii байт, разбирается
+ * скалярно целиком (вместе с последовательностью, выходящей за его конец),
+ * и только затем проверяется следующий блок: иначе в тексте не на латинице
+ * проверка повторялась бы впустую перед каждым символом.
+ */
+int decodeUtf8(const uchar *in, int size, ushort *out)
+{
+    int pos = 0;
+    int written = 0;
+
+    while (pos < size)
+    {
+        // позиции ascii символов во входе и выходе совпадают со сдвигом
+        int ascii = copyAscii(in + pos, size - pos, out + written);
+        pos += ascii;
+        written += ascii;
+
+        // скалярно - блок с не ascii байтом или хвост короче блока
+        int block_end = vector_block > 0 ? qMin(size, pos + vector_block)
+                                         : size;
+        while (pos < block_end)
+        {
+            while (pos < block_end && in[pos] < 0x80)
+            {
+                out[written++] = in[pos++];
+            }
+            if (pos >= block_end)
+            {
+                break;
+            }
+            int length = decodeSequence(in + pos, size - pos, out, written);
+            if (length < 0)
+            {
+                return -1;
+            }
+            pos += length;
+        }
+    }
+    return written;
+}
+
+}
+
+
+/**
+ * @brief Проверка и преобразование UTF-8
+ * @param data - байты сообщения
+ * @param result - сюда записывается текст сообщения
+ * @return true, если данные - корректный UTF-8, иначе - false (result пуст)
+ *
+ * количество элементов UTF-16 не превышает количество байт UTF-8, поэтому
+ * буфер строки выделяется один раз, а затем обрезается.
+ */
+bool Utf8Decoder::decode(const QByteArray &data, QString &result)
+{
+    result = QString(data.size(), Qt::Uninitialized);
+    int written = decodeUtf8(reinterpret_cast<const uchar *>(data.constData()),
+                             data.size(),
+                             reinterpret_cast<ushort *>(result.data()));
+    if (written < 0)
+    {
+        result.clear();
+        return false;
+    }
+    result.resize(written);
+    return true;
+}
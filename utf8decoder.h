@@ -0,0 +1,23 @@
+#ifndef UTF8DECODER_H
+#define UTF8DECODER_H
+
+#include <QByteArray>
+#include <QString>
+
+
+/**
+ * @brief Проверка и преобразование UTF-8 в QString за один проход
+ *
+ * участки ascii обрабатываются векторно (AVX2/SSE2 на x86, NEON на ARM,
+ * по набору инструкций, для которого собрана программа), остальные
+ * последовательности - скалярно со строгой проверкой (лишние байты
+ * продолжения, избыточная запись, суррогаты, значения больше U+10FFFF
+ * считаются ошибкой). Результат пишется прямо в буфер QString.
+ */
+class Utf8Decoder
+{
+public:
+    static bool decode(const QByteArray &data, QString &result);
+};
+
+#endif // UTF8DECODER_H